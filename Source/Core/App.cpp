@@ -31,6 +31,9 @@
 #include "ScaledComponentProxy.h"
 #include "Workspace.h"
 #include "RootNode.h"
+#include "Models/MarkovCorpusTrainer.h"
+#include "Models/MarkovBenchmark.h"
+#include "JsonSerializer.h"
 
 //===----------------------------------------------------------------------===//
 // Window
@@ -500,7 +503,15 @@ void App::setTitleBarComponent(WeakReference<Component> component)
 
 void App::initialise(const String &commandLine)
 {
-    if (commandLine.isNotEmpty() &&
+    if (commandLine.startsWith(App::trainMarkovModelCommand))
+    {
+        this->runMode = RunMode::MarkovTraining;
+    }
+    else if (commandLine.startsWith(App::benchmarkMarkovModelsCommand))
+    {
+        this->runMode = RunMode::MarkovBenchmark;
+    }
+    else if (commandLine.isNotEmpty() &&
         DocumentHelpers::getTempSlot(commandLine).existsAsFile())
     {
         this->runMode = RunMode::PluginCheck;
@@ -585,6 +596,17 @@ void App::initialise(const String &commandLine)
         this->checkPlugin(commandLine);
         this->quit();
     }
+    else if (this->runMode == RunMode::MarkovTraining)
+    {
+        // no config, no ui, no audio: only the models code is used
+        this->trainMarkovModel(commandLine);
+        this->quit();
+    }
+    else if (this->runMode == RunMode::MarkovBenchmark)
+    {
+        this->benchmarkMarkovModels(commandLine);
+        this->quit();
+    }
 }
 
 void App::shutdown()
@@ -624,6 +646,14 @@ const String App::getApplicationName()
     {
         return "Helio Plugin Check";
     }
+    else if (this->runMode == RunMode::MarkovTraining)
+    {
+        return "Helio Markov Trainer";
+    }
+    else if (this->runMode == RunMode::MarkovBenchmark)
+    {
+        return "Helio Markov Benchmark";
+    }
 
     return "Helio";
 }
@@ -732,6 +762,92 @@ void App::checkPlugin(const String &markerFile)
     }
 }
 
+// helio --train-markov <midi files directory> <output file> [order] [threads]
+void App::trainMarkovModel(const String &commandLine)
+{
+#if JUCE_MAC
+    Process::setDockIconVisible(false);
+#endif
+
+    StringArray args;
+    args.addTokens(commandLine, true);
+    args.removeEmptyStrings();
+
+    const auto workingDirectory = File::getCurrentWorkingDirectory();
+    const auto corpusDirectory = workingDirectory.getChildFile(args[1].unquoted());
+    const auto outputFile = workingDirectory.getChildFile(args[2].unquoted());
+
+    if (args.size() < 3 || !corpusDirectory.isDirectory())
+    {
+        Logger::writeToLog("Usage: helio " + String(App::trainMarkovModelCommand) +
+            " <midi files directory> <output file> [order] [threads]");
+        this->setApplicationReturnValue(1);
+        return;
+    }
+
+    const auto order = args.size() > 3 ? args[3].getIntValue() : 1;
+    const auto numThreads = args.size() > 4 ? args[4].getIntValue() : 0;
+
+    const auto files = MarkovCorpusTrainer::findMidiFiles(corpusDirectory);
+    Logger::writeToLog("Training on " + String(files.size()) + " files");
+
+    const auto startTime = Time::getMillisecondCounterHiRes();
+
+    MarkovModel model;
+    const MarkovCorpusTrainer trainer(order, numThreads);
+    const auto numImportedFiles = trainer.train(files, model);
+
+    // saving with the sampling tables also builds them
+    const auto result = model.saveToFile(outputFile, true);
+    const auto elapsedMs = Time::getMillisecondCounterHiRes() - startTime;
+
+    if (result.failed())
+    {
+        Logger::writeToLog(result.getErrorMessage());
+        this->setApplicationReturnValue(1);
+        return;
+    }
+
+    Logger::writeToLog("Imported " + String(numImportedFiles) + " files, " +
+        String(model.Size()) + " states, " + String(elapsedMs / 1000.0, 2) + "s");
+}
+
+// helio --benchmark-markov <output json file> [midi files directory]
+void App::benchmarkMarkovModels(const String &commandLine)
+{
+#if JUCE_MAC
+    Process::setDockIconVisible(false);
+#endif
+
+    StringArray args;
+    args.addTokens(commandLine, true);
+    args.removeEmptyStrings();
+
+    if (args.size() < 2)
+    {
+        Logger::writeToLog("Usage: helio " + String(App::benchmarkMarkovModelsCommand) +
+            " <output json file> [midi files directory]");
+        this->setApplicationReturnValue(1);
+        return;
+    }
+
+    const auto workingDirectory = File::getCurrentWorkingDirectory();
+    const auto outputFile = workingDirectory.getChildFile(args[1].unquoted());
+    const auto fixturesDirectory = args.size() > 2 ?
+        workingDirectory.getChildFile(args[2].unquoted()) : File();
+
+    const MarkovBenchmark benchmark;
+    auto results = benchmark.run(fixturesDirectory);
+    results.setProperty(Serialization::Midi::Markov::Benchmark::version,
+        App::getAppReadableVersion());
+
+    if (!DocumentHelpers::save<JsonSerializer>(outputFile, results))
+    {
+        Logger::writeToLog("Failed to save " + outputFile.getFullPathName());
+        this->setApplicationReturnValue(1);
+    }
+}
+
 void App::handleAsyncUpdate()
 {
     JUCEApplication::quit();
@@ -124,10 +124,20 @@ private:
 
     void checkPlugin(const String &markerFile);
 
+    // the headless corpus training, see MarkovCorpusTrainer
+    static constexpr auto trainMarkovModelCommand = "--train-markov";
+    void trainMarkovModel(const String &commandLine);
+
+    // the headless performance tests, see MarkovBenchmark
+    static constexpr auto benchmarkMarkovModelsCommand = "--benchmark-markov";
+    void benchmarkMarkovModels(const String &commandLine);
+
     enum class RunMode
     {
         Normal,
-        PluginCheck
+        PluginCheck,
+        MarkovTraining,
+        MarkovBenchmark
     };
 
     RunMode runMode = RunMode::Normal;
@@ -639,7 +639,10 @@ public:
 
     void readRegions();
 
-    SharedAudioSampleBuffer::Ptr readSamples();
+    SharedAudioSampleBuffer::Ptr readSamples(const Function<bool()> &shouldAbort);
+
+    // Returns nullptr if the sample data can't be mapped
+    SharedMappedSampleData::Ptr mapSamples();
 
 protected:
 
@@ -866,7 +869,7 @@ Optional<RIFFChunk> SoundFont2Reader::seekToSampleSection()
     return chunk;
 }
 
-SharedAudioSampleBuffer::Ptr SoundFont2Reader::readSamples()
+SharedAudioSampleBuffer::Ptr SoundFont2Reader::readSamples(const Function<bool()> &shouldAbort)
 {
     const auto samplesChunk = this->seekToSampleSection();
     if (!samplesChunk.hasValue())
@@ -885,6 +888,11 @@ SharedAudioSampleBuffer::Ptr SoundFont2Reader::readSamples()
     float *out = sampleBuffer->getWritePointer(0);
     while (samplesLeft > 0)
     {
+        if (shouldAbort())
+        {
+            return nullptr;
+        }
+
         // Read <= 32768 bytes at a time from the buffer
         int samplesToRead = bufferSize;
         if (samplesToRead > samplesLeft)
@@ -910,6 +918,18 @@ SharedAudioSampleBuffer::Ptr SoundFont2Reader::readSamples()
     return sampleBuffer;
 }
 
+SharedMappedSampleData::Ptr SoundFont2Reader::mapSamples()
+{
+    const auto samplesChunk = this->seekToSampleSection();
+    if (!samplesChunk.hasValue())
+    {
+        return nullptr;
+    }
+
+    const Range<int64> range(samplesChunk->start, samplesChunk->start + samplesChunk->size);
+    return SharedMappedSampleData::map(this->fileInputStream->getFile(), range);
+}
+
 void SoundFont2Reader::addGeneratorToRegion(sf2word genOper, SF2::genAmountType *amount, SoundFontRegion *region)
 {
     switch (genOper)
@@ -1106,14 +1126,69 @@ void SoundFont2Sound::loadRegions()
     this->setSelectedPreset(0);
 }
 
-void SoundFont2Sound::loadSamples(AudioFormatManager &formatManager)
+void SoundFont2Sound::loadSamples(AudioFormatManager &formatManager,
+    const Function<bool()> &shouldAbort)
 {
     /*
         each SoundFont2Sound is given a File as the source of the actual sample data when they're created
         this reader adds any errors encountered while reading to the SoundFont2Sound object
     */
-    SoundFont2Reader reader(*this, this->file);
-    const auto buffer = reader.readSamples();
+
+    // the sample data is memory-mapped, so that the large SoundFonts
+    // don't have to be loaded into memory as a whole, and preloading
+    // only the notes' attacks, the rest is read from disk when played;
+    // if it can't be mapped, all the samples are loaded, like they used to be
+    const auto mappedData = this->getCachedSampleData<SharedMappedSampleData>("sf2-mapped",
+        [this, &shouldAbort]() -> SharedMappedSampleData::Ptr
+        {
+            SoundFont2Reader reader(*this, this->file);
+            const auto data = reader.mapSamples();
+
+            // the chunks are supposed to be word-aligned, but just in case
+            if (data == nullptr || !data->hasSamples())
+            {
+                return nullptr;
+            }
+
+            constexpr int64 preloadedSamples = 32768;
+            for (auto *preset : this->presets)
+            {
+                if (shouldAbort())
+                {
+                    return nullptr;
+                }
+
+                for (auto *region : preset->regions)
+                {
+                    data->preload(region->offset,
+                        jmin(preloadedSamples, region->end - region->offset));
+                }
+            }
+
+            return data;
+        });
+
+    if (mappedData != nullptr)
+    {
+        for (auto &sample : this->samplesByRate)
+        {
+            sample.second->setMappedData(mappedData);
+        }
+
+        return;
+    }
+
+    if (shouldAbort())
+    {
+        return;
+    }
+
+    const auto buffer = this->getCachedSampleData<SharedAudioSampleBuffer>("sf2",
+        [this, &shouldAbort]()
+        {
+            SoundFont2Reader reader(*this, this->file);
+            return reader.readSamples(shouldAbort);
+        });
 
     if (buffer)
     {
@@ -1159,6 +1234,8 @@ void SoundFont2Sound::setSelectedPreset(int whichPreset)
     {
         this->regions.addArray(this->presets[whichPreset]->regions);
     }
+
+    this->rebuildRegionsIndex();
 }
 
 int SoundFont2Sound::getSelectedPreset() const
@@ -1214,6 +1291,25 @@ struct SampleRangeHash
     }
 };
 
+// The decompressed samples of a file, shared by its sounds,
+// and where each of the compressed samples has been decompressed to
+class SoundFont3SampleData final : public ReferenceCountedObject
+{
+public:
+
+    using Ptr = ReferenceCountedObjectPtr<SoundFont3SampleData>;
+
+    SoundFont3SampleData() = default;
+
+    SharedAudioSampleBuffer::Ptr buffer;
+
+    // ranges in bytes in compressed stream
+    // to ranges in 16-bit sample data points in uncompressed stream
+    FlatHashMap<Range<int64>, Range<int64>, SampleRangeHash> decompressedRanges;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFont3SampleData)
+};
+
 SoundFont3Sound::SoundFont3Sound(const File &file) : SoundFont2Sound(file) {}
 
 SoundFont3Sound::~SoundFont3Sound() = default;
@@ -1235,7 +1331,8 @@ UniquePointer<AudioFormatReader> SoundFont3Sound::makeReaderFor(const void *read
     return {};
 }
 
-void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager)
+void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager,
+    const Function<bool()> &shouldAbort)
 {
     if (this->presets.isEmpty())
     {
@@ -1243,23 +1340,65 @@ void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager)
         return;
     }
 
+    const auto sampleData = this->getCachedSampleData<SoundFont3SampleData>("sf3",
+        [this, &shouldAbort]() { return this->decompressSamples(shouldAbort); });
+
+    if (sampleData == nullptr)
+    {
+        return;
+    }
+
+    for (auto *preset : this->presets)
+    {
+        // re-calculate regions' sample offsets
+        for (auto *region : preset->regions)
+        {
+            const Range<int64> compressedByteRange(region->offset, region->end);
+            const auto foundDecompressedRange = sampleData->decompressedRanges.find(compressedByteRange);
+            if (foundDecompressedRange != sampleData->decompressedRanges.end())
+            {
+                region->offset = foundDecompressedRange->second.getStart();
+                region->end = foundDecompressedRange->second.getEnd();
+            }
+
+            // in SF3, loop start and end are based on the beginning of each sample,
+            // we need them to be based on the beginning of the decompressed sample buffer
+            region->loopStart += region->offset;
+            region->loopEnd += region->offset;
+        }
+    }
+
+    for (auto &sample : this->samplesByRate)
+    {
+        sample.second->setBuffer(sampleData->buffer);
+    }
+}
+
+SoundFont3SampleData::Ptr SoundFont3Sound::decompressSamples(const Function<bool()> &shouldAbort)
+{
 #if DEBUG
     auto startTime = Time::getMillisecondCounter();
 #endif
 
+    // the compressed samples are only needed while decompressing them,
+    // so the section is memory-mapped instead of being read, if possible
     SoundFont3Reader soundFontReader(*this, this->file);
-    const auto samplesBlock = soundFontReader.readSamplesSection();
-    if (samplesBlock.isEmpty())
+    const auto mappedSection = soundFontReader.mapSamples();
+    const auto samplesBlock = mappedSection == nullptr ?
+        soundFontReader.readSamplesSection() : MemoryBlock();
+
+    const auto *sampleBlockStart = mappedSection != nullptr ?
+        mappedSection->getData() : static_cast<const char *>(samplesBlock.getData());
+    const auto sampleBlockSize = mappedSection != nullptr ?
+        mappedSection->getSize() : samplesBlock.getSize();
+
+    if (sampleBlockSize == 0)
     {
         jassertfalse;
-        return;
+        return nullptr;
     }
 
-    const auto *sampleBlockStart = static_cast<const char *>(samplesBlock.getData());
-
-    // ranges in bytes in compressed stream
-    // to ranges in 16-bit sample data points in uncompressed stream
-    FlatHashMap<Range<int64>, Range<int64>, SampleRangeHash> decompressedRanges;
+    SoundFont3SampleData::Ptr result(new SoundFont3SampleData());
 
     // we have to precompute the length of the uncompressed samples buffer
     // to avoid resizing it later, which would cause painful reallocations
@@ -1278,10 +1417,15 @@ void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager)
 
         for (const auto &range : uniqueCompressedRanges)
         {
+            if (shouldAbort())
+            {
+                return nullptr;
+            }
+
             const auto *readStart = static_cast<const void *>(sampleBlockStart + range.getStart());
             const auto readLength = range.getLength() > 0 ?
                 size_t(range.getLength()) :
-                size_t(samplesBlock.getSize() - range.getStart());
+                size_t(sampleBlockSize - range.getStart());
 
             // even though this involves creating readers and parsing sample headers,
             // it is still cheaper and faster than resizing the buffer later
@@ -1301,28 +1445,31 @@ void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager)
 
     for (auto *preset : this->presets)
     {
-        // decompress samples and re-calculate regions' sample offsets
+        // decompress samples, the regions' offsets are updated by the caller
         for (auto *region : preset->regions)
         {
             const Range<int64> compressedByteRange(region->offset, region->end);
-            const auto foundDecompressedRange = decompressedRanges.find(compressedByteRange);
-            if (foundDecompressedRange != decompressedRanges.end())
+            if (result->decompressedRanges.find(compressedByteRange) !=
+                result->decompressedRanges.end())
             {
                 // the decompressed region is already present in the shared buffer
-                region->offset = foundDecompressedRange->second.getStart();
-                region->end = foundDecompressedRange->second.getEnd();
                 continue;
             }
 
+            if (shouldAbort())
+            {
+                return nullptr;
+            }
+
             //DBG("Reading sample at " + String(region->offset));
 
-            jassert(region->end <= int64(samplesBlock.getSize()));
-            jassert(region->offset < int64(samplesBlock.getSize()));
+            jassert(region->end <= int64(sampleBlockSize));
+            jassert(region->offset < int64(sampleBlockSize));
 
             const auto *readStart = static_cast<const void *>(sampleBlockStart + region->offset);
             const auto readLength = region->end > region->offset ?
                 size_t(region->end - region->offset) :
-                size_t(samplesBlock.getSize() - region->offset);
+                size_t(sampleBlockSize - region->offset);
 
             const auto sampleReader = this->makeReaderFor(readStart, readLength);
             if (sampleReader == nullptr)
@@ -1341,31 +1488,15 @@ void SoundFont3Sound::loadSamples(AudioFormatManager &formatManager)
             const Range<int64> decompressedSampleRange(currentSampleOffset,
                 currentSampleOffset + sampleReader->lengthInSamples);
 
-            decompressedRanges[compressedByteRange] = decompressedSampleRange;
-
-            region->offset = decompressedSampleRange.getStart();
-            region->end = decompressedSampleRange.getEnd();
+            result->decompressedRanges[compressedByteRange] = decompressedSampleRange;
 
             currentSampleOffset += sampleReader->lengthInSamples;
         }
     }
 
-    // in SF3, loop start and end are based on the beginning of each sample,
-    // we need them to be based on the beginning of the decompressed sample buffer
-    for (auto *preset : this->presets)
-    {
-        for (auto *region : preset->regions)
-        {
-            region->loopStart += region->offset;
-            region->loopEnd += region->offset;
-        }
-    }
-
     DBG("SoundFont: loaded samples in " + String(Time::getMillisecondCounter() - startTime) + " ms");
     DBG("SoundFont: allocated sample buffer of " + String(sampleBuffer->getNumSamples()) + " samples");
 
-    for (auto &sample : this->samplesByRate)
-    {
-        sample.second->setBuffer(sampleBuffer);
-    }
+    result->buffer = sampleBuffer;
+    return result;
 }
@@ -31,7 +31,8 @@ public:
     ~SoundFont2Sound() override;
 
     void loadRegions() override;
-    void loadSamples(AudioFormatManager &formatManager) override;
+    void loadSamples(AudioFormatManager &formatManager,
+        const Function<bool()> &shouldAbort) override;
 
     int getNumPresets() const override;
     String getPresetName(int whichPreset) const override;
@@ -54,6 +55,8 @@ protected:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFont2Sound)
 };
 
+class SoundFont3SampleData;
+
 // the same as SoundFont2Sound, but supports OGG/FLAC-compressed samples
 class SoundFont3Sound final : public SoundFont2Sound
 {
@@ -62,7 +65,8 @@ public:
     explicit SoundFont3Sound(const File &file);
     ~SoundFont3Sound() override;
 
-    void loadSamples(AudioFormatManager &formatManager) override;
+    void loadSamples(AudioFormatManager &formatManager,
+        const Function<bool()> &shouldAbort) override;
 
 private:
 
@@ -70,5 +74,9 @@ private:
     OggVorbisAudioFormat oggVorbisAudioFormat;
     UniquePointer<AudioFormatReader> makeReaderFor(const void *start, size_t length);
 
+    // Decompresses all the samples into a single buffer,
+    // leaving the regions' offsets as they are
+    ReferenceCountedObjectPtr<SoundFont3SampleData> decompressSamples(const Function<bool()> &shouldAbort);
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFont3Sound)
 };
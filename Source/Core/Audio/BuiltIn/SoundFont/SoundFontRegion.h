@@ -176,14 +176,20 @@ struct SoundFontRegion final
         return info;
     }
 
-    bool matches(int note, int velocity, Trigger trigger, int periodSize) const noexcept
+    // Microtonal notes are mapped onto the 12-tone keys which the regions are defined for
+    static int mapNote(int note, int periodSize) noexcept
     {
-        int mappedNote = note;
         if (periodSize != Globals::twelveTonePeriodSize)
         {
-            mappedNote = int(double(note * Globals::twelveTonePeriodSize) / double(periodSize));
+            return int(double(note * Globals::twelveTonePeriodSize) / double(periodSize));
         }
 
+        return note;
+    }
+
+    bool matches(int note, int velocity, Trigger trigger, int periodSize) const noexcept
+    {
+        const auto mappedNote = SoundFontRegion::mapNote(note, periodSize);
         return (mappedNote >= this->lokey && mappedNote <= this->hikey &&
             velocity >= this->lovel && velocity <= this->hivel &&
             (trigger == this->trigger ||
@@ -33,6 +33,80 @@ public:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedAudioSampleBuffer)
 };
 
+// A memory-mapped part of a SoundFont file: instead of loading the whole
+// sample data at once, the pages are read from disk when they are first
+// played, and the system can drop them again when it runs out of memory;
+// as the sample data, it is 16-bit mono, converted to floats on the fly
+class SharedMappedSampleData final : public ReferenceCountedObject
+{
+public:
+
+    using Ptr = ReferenceCountedObjectPtr<SharedMappedSampleData>;
+
+    // Returns nullptr if the range can't be mapped
+    static Ptr map(const File &file, Range<int64> range)
+    {
+        auto mappedFile = make<MemoryMappedFile>(file, range, MemoryMappedFile::readOnly);
+        if (mappedFile->getData() == nullptr ||
+            mappedFile->getRange().getEnd() < range.getEnd())
+        {
+            return nullptr;
+        }
+
+        // the mapped range starts at the page boundary
+        const auto *data = static_cast<const char *>(mappedFile->getData()) +
+            (range.getStart() - mappedFile->getRange().getStart());
+
+        return new SharedMappedSampleData(move(mappedFile), data, size_t(range.getLength()));
+    }
+
+    const char *getData() const noexcept { return this->data; }
+    size_t getSize() const noexcept { return this->size; }
+
+    bool hasSamples() const noexcept
+    {
+        return (reinterpret_cast<pointer_sized_int>(this->data) % sizeof(int16)) == 0;
+    }
+
+    const int16 *getSamples() const noexcept
+    {
+        jassert(this->hasSamples());
+        return reinterpret_cast<const int16 *>(this->data);
+    }
+
+    int getNumSamples() const noexcept
+    {
+        return int(this->size / sizeof(int16));
+    }
+
+    // Touches the pages of the given range of samples, so that
+    // the notes' attacks don't have to wait for the disk
+    void preload(int64 startSample, int64 numSamples) const noexcept
+    {
+        constexpr auto samplesPerPage = 4096 / int64(sizeof(int16));
+        const auto *samples = this->getSamples();
+        const auto start = jlimit(int64(0), int64(this->getNumSamples()), startSample);
+        const auto end = jlimit(start, int64(this->getNumSamples()), startSample + numSamples);
+        volatile int16 touched = 0;
+        for (auto i = start; i < end; i += samplesPerPage)
+        {
+            touched = samples[i];
+        }
+    }
+
+private:
+
+    SharedMappedSampleData(UniquePointer<MemoryMappedFile> &&mappedFileIn,
+        const char *dataIn, size_t sizeIn) :
+        mappedFile(move(mappedFileIn)), data(dataIn), size(sizeIn) {}
+
+    const UniquePointer<MemoryMappedFile> mappedFile;
+    const char *const data;
+    const size_t size;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedMappedSampleData)
+};
+
 class SoundFontSample final
 {
 public:
@@ -46,9 +120,26 @@ public:
     File getFile() const noexcept { return this->file; }
     String getShortName() const noexcept { return this->file.getFileName(); }
 
+    // Either the buffer or the mapped data is set, see hasData()
     const AudioSampleBuffer *getBuffer() const noexcept { return this->buffer.get(); }
+    const SharedMappedSampleData *getMappedData() const noexcept { return this->mappedData.get(); }
+
+    bool hasData() const noexcept
+    {
+        return this->buffer != nullptr || this->mappedData != nullptr;
+    }
+
+    void setMappedData(SharedMappedSampleData::Ptr newData)
+    {
+        jassert(newData == nullptr || newData->hasSamples());
+        this->buffer = nullptr;
+        this->mappedData = newData;
+        this->sampleLength = newData != nullptr ? newData->getNumSamples() : 0;
+    }
+
     void setBuffer(SharedAudioSampleBuffer::Ptr newBuffer)
     {
+        this->mappedData = nullptr;
         this->buffer = newBuffer;
         if (this->buffer != nullptr)
         {
@@ -100,6 +191,7 @@ private:
 
     // all samples share the single buffer:
     SharedAudioSampleBuffer::Ptr buffer;
+    SharedMappedSampleData::Ptr mappedData;
 
     double sampleRate = 0.0;
     uint64 sampleLength = 0;
@@ -0,0 +1,47 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "SoundFontSampleCache.h"
+
+String SoundFontSampleCache::makeKey(const File &file, const String &kind)
+{
+    // the modification time is there to reload the edited files
+    return file.getFullPathName() + "|" +
+        String(file.getLastModificationTime().toMilliseconds()) + "|" + kind;
+}
+
+void SoundFontSampleCache::removeUnusedEntries()
+{
+    const ScopedLock lock(this->entriesLock);
+
+    for (auto it = this->entries.begin(); it != this->entries.end() ;)
+    {
+        // the cache itself holds one reference to the entry and to its data,
+        // and no one else can get the entry while the entries are locked
+        const auto &entry = it->second;
+        if (entry->getReferenceCount() == 1 &&
+            (entry->data == nullptr || entry->data->getReferenceCount() == 1))
+        {
+            it = this->entries.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// A process-wide cache of the SoundFonts' sample data, so that
+// the instruments using the same SoundFont, e.g. with different programs,
+// share the loaded samples instead of loading them again each.
+//
+// The entries are keyed by the file, its modification time, and the kind
+// of the data, and are held until no sound uses them anymore; the sounds
+// keep their cached data alive via SoundFontSound::getCachedSampleData,
+// and call removeUnusedEntries when they release it.
+
+class SoundFontSampleCache final
+{
+public:
+
+    SoundFontSampleCache() = default;
+
+    using DataPtr = ReferenceCountedObjectPtr<ReferenceCountedObject>;
+
+    // Returns the cached data, or loads it and adds to the cache;
+    // the loader may return nullptr, which is not cached
+    template <typename T>
+    ReferenceCountedObjectPtr<T> get(const File &file, const String &kind,
+        const Function<ReferenceCountedObjectPtr<T>()> &load)
+    {
+        Entry::Ptr entry;
+
+        {
+            const ScopedLock lock(this->entriesLock);
+            auto &foundEntry = this->entries[SoundFontSampleCache::makeKey(file, kind)];
+            if (foundEntry == nullptr)
+            {
+                foundEntry = new Entry();
+            }
+
+            entry = foundEntry;
+        }
+
+        // loading while holding only this entry's lock, so that the same data
+        // is never loaded twice at the same time, and the other files' loading
+        // doesn't have to wait for it; the ones which need the same data
+        // wait for it here, and then just take it
+        const ScopedLock lock(entry->lock);
+        if (auto *data = dynamic_cast<T *>(entry->data.get()))
+        {
+            return data;
+        }
+
+        ReferenceCountedObjectPtr<T> data = load();
+        entry->data = data.get();
+        return data;
+    }
+
+    // Drops the entries which no sound uses anymore
+    void removeUnusedEntries();
+
+private:
+
+    static String makeKey(const File &file, const String &kind);
+
+    // the data is null until loaded, or if the loading has failed
+    struct Entry final : ReferenceCountedObject
+    {
+        using Ptr = ReferenceCountedObjectPtr<Entry>;
+        CriticalSection lock;
+        DataPtr data;
+    };
+
+    CriticalSection entriesLock;
+    FlatHashMap<String, Entry::Ptr, StringHash> entries;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontSampleCache)
+};
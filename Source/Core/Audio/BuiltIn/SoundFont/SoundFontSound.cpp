@@ -669,7 +669,13 @@ SoundFontSound::SoundFontSound(const File &fileIn) : file(fileIn)
     this->preset = make<Preset>();
 }
 
-SoundFontSound::~SoundFontSound() = default;
+SoundFontSound::~SoundFontSound()
+{
+    // the subclasses' samples are already gone at this point, so this
+    // releases the last references to the data no other sound shares
+    this->cachedSampleData.clear();
+    this->sampleCache->removeUnusedEntries();
+}
 
 bool SoundFontSound::appliesToNote(int /*midiNoteNumber*/)
 {
@@ -727,12 +733,19 @@ void SoundFontSound::loadRegions()
 {
     SoundFontReader reader(this);
     reader.read(this->file);
+    this->rebuildRegionsIndex();
 }
 
-void SoundFontSound::loadSamples(AudioFormatManager &formatManager)
+void SoundFontSound::loadSamples(AudioFormatManager &formatManager,
+    const Function<bool()> &shouldAbort)
 {
     for (auto &it : this->samples)
     {
+        if (shouldAbort())
+        {
+            return;
+        }
+
         const bool ok = it.second->load(formatManager);
         if (!ok)
         {
@@ -747,7 +760,7 @@ SoundFontRegion *SoundFontSound::getRegionFor(int note,
     jassert(this->temperament != nullptr);
     const auto periodSize = this->temperament->getPeriodSize();
 
-    for (auto *region : this->regions)
+    for (auto *region : this->getRegionsFor(note, velocity))
     {
         if (region->matches(note, velocity, trigger, periodSize))
         {
@@ -758,6 +771,111 @@ SoundFontRegion *SoundFontSound::getRegionFor(int note,
     return nullptr;
 }
 
+SoundFontSound::RegionsRange SoundFontSound::getRegionsFor(int note, int velocity) const noexcept
+{
+    jassert(this->temperament != nullptr);
+    const auto key = SoundFontRegion::mapNote(note, this->temperament->getPeriodSize());
+
+    if (key < 0 || key >= numIndexedKeys ||
+        velocity < 0 || velocity >= numIndexedVelocities)
+    {
+        // not indexed, so all regions are the candidates
+        return { this->regions.begin(), this->regions.end() };
+    }
+
+    const auto firstLayer = this->keyLayers[key];
+    auto layer = this->keyLayers[key + 1] - 1;
+    if (layer < firstLayer)
+    {
+        return {};
+    }
+
+    // there are only a few layers per key, and the first one starts at zero
+    while (layer > firstLayer && this->velocityLayers[layer].lowestVelocity > velocity)
+    {
+        layer--;
+    }
+
+    const auto &found = this->velocityLayers[layer];
+    const auto *first = this->indexedRegions.data() + found.firstRegion;
+    return { first, first + found.numRegions };
+}
+
+void SoundFontSound::rebuildRegionsIndex()
+{
+    this->indexedRegions.clear();
+    this->velocityLayers.clear();
+
+    std::vector<SoundFontRegion *> keyRegions;
+    std::vector<int> boundaries;
+
+    for (int key = 0; key < numIndexedKeys; ++key)
+    {
+        this->keyLayers[key] = int(this->velocityLayers.size());
+
+        keyRegions.clear();
+        boundaries.clear();
+        boundaries.push_back(0);
+
+        for (auto *region : this->regions)
+        {
+            if (key >= region->lokey && key <= region->hikey)
+            {
+                keyRegions.push_back(region);
+                boundaries.push_back(region->lovel);
+                boundaries.push_back(region->hivel + 1);
+            }
+        }
+
+        if (keyRegions.empty())
+        {
+            continue;
+        }
+
+        std::sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+        // the set of matching regions only changes at the boundaries,
+        // so checking the lowest velocity of each layer is enough
+        for (const auto velocity : boundaries)
+        {
+            if (velocity < 0 || velocity >= numIndexedVelocities)
+            {
+                continue;
+            }
+
+            const auto firstRegion = int(this->indexedRegions.size());
+            for (auto *region : keyRegions)
+            {
+                if (velocity >= region->lovel && velocity <= region->hivel)
+                {
+                    this->indexedRegions.push_back(region);
+                }
+            }
+
+            const auto numRegions = int(this->indexedRegions.size()) - firstRegion;
+
+            // merge with the previous layer if the regions are the same
+            if (int(this->velocityLayers.size()) > this->keyLayers[key])
+            {
+                const auto &previous = this->velocityLayers.back();
+                const auto *previousRegions = this->indexedRegions.data() + previous.firstRegion;
+                if (previous.numRegions == numRegions &&
+                    std::equal(previousRegions, previousRegions + numRegions,
+                        this->indexedRegions.data() + firstRegion))
+                {
+                    this->indexedRegions.resize(firstRegion);
+                    continue;
+                }
+            }
+
+            this->velocityLayers.push_back({ velocity, firstRegion, numRegions });
+        }
+    }
+
+    this->keyLayers[numIndexedKeys] = int(this->velocityLayers.size());
+}
+
 int SoundFontSound::getNumRegions() const { return this->regions.size(); }
 
 SoundFontRegion *SoundFontSound::regionAt(int index) { return this->regions[index]; }
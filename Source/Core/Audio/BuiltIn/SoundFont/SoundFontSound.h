@@ -22,6 +22,7 @@
 #pragma once
 
 #include "SoundFontRegion.h"
+#include "SoundFontSampleCache.h"
 #include "Temperament.h"
 
 class SoundFontSample;
@@ -39,11 +40,29 @@ public:
     bool appliesToChannel(int midiChannel) override;
 
     virtual void loadRegions();
-    virtual void loadSamples(AudioFormatManager &formatManager);
+
+    // The abort check is called between the chunks of work, and if it returns true,
+    // the loading stops early, leaving the samples not loaded and not cached
+    virtual void loadSamples(AudioFormatManager &formatManager,
+        const Function<bool()> &shouldAbort);
 
     SoundFontRegion *getRegionFor(int note, int velocity,
         SoundFontRegion::Trigger trigger = SoundFontRegion::Trigger::attack) const;
 
+    struct RegionsRange final
+    {
+        SoundFontRegion *const *first = nullptr;
+        SoundFontRegion *const *last = nullptr;
+
+        SoundFontRegion *const *begin() const noexcept { return this->first; }
+        SoundFontRegion *const *end() const noexcept { return this->last; }
+    };
+
+    // The regions which may match the note and the velocity, in their
+    // original order, looked up in the index instead of checking all regions
+    // on each note-on; the callers still need to check SoundFontRegion::matches
+    RegionsRange getRegionsFor(int note, int velocity) const noexcept;
+
     int getNumRegions() const;
     SoundFontRegion *regionAt(int index);
 
@@ -57,6 +76,8 @@ public:
 
     void setTemperament(Temperament::Ptr temperament)
     {
+        // the index is keyed by the 12-tone keys,
+        // so it doesn't depend on the temperament
         this->temperament = temperament;
     }
 
@@ -89,6 +110,24 @@ protected:
 
     Array<SoundFontRegion *> regions;
 
+    // Should be called whenever the regions list changes
+    void rebuildRegionsIndex();
+
+    // Shares the sample data of this sound's file with the other instances,
+    // and keeps it cached while this sound is alive
+    template <typename T>
+    ReferenceCountedObjectPtr<T> getCachedSampleData(const String &kind,
+        const Function<ReferenceCountedObjectPtr<T>()> &load)
+    {
+        auto data = this->sampleCache->get<T>(this->file, kind, load);
+        if (data != nullptr)
+        {
+            this->cachedSampleData.add(data.get());
+        }
+
+        return data;
+    }
+
 private:
 
     friend class SoundFontReader;
@@ -105,5 +144,30 @@ private:
 
     Temperament::Ptr temperament;
 
+    SharedResourcePointer<SoundFontSampleCache> sampleCache;
+    ReferenceCountedArray<ReferenceCountedObject> cachedSampleData;
+
+    //===------------------------------------------------------------------===//
+    // Regions index
+    //===------------------------------------------------------------------===//
+
+    static constexpr auto numIndexedKeys = 128;
+    static constexpr auto numIndexedVelocities = 128;
+
+    // a velocity range of a key where the set of matching regions is the same,
+    // which lasts until the lowest velocity of the next layer of that key
+    struct VelocityLayer final
+    {
+        int lowestVelocity;
+        int firstRegion;
+        int numRegions;
+    };
+
+    std::vector<SoundFontRegion *> indexedRegions;
+    std::vector<VelocityLayer> velocityLayers;
+
+    // the layers of each key are [keyLayers[key], keyLayers[key + 1])
+    int keyLayers[numIndexedKeys + 1] = {};
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontSound)
 };
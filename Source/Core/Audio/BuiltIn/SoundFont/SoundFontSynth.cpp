@@ -29,6 +29,17 @@
 #include "DocumentHelpers.h"
 #include "SerializationKeys.h"
 
+#if JUCE_USE_SSE_INTRINSICS
+#   include <emmintrin.h>
+#elif JUCE_USE_ARM_NEON
+#   include <arm_neon.h>
+#endif
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_ANDROID || JUCE_IOS
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
 class SoundFontEnvelope final
 {
 public:
@@ -278,6 +289,199 @@ void SoundFontEnvelope::startRelease()
     }
 }
 
+//===----------------------------------------------------------------------===//
+// Voice rendering kernels
+//===----------------------------------------------------------------------===//
+
+static inline float toFloatSample(float sample) noexcept { return sample; }
+
+// the same conversion as when the whole sample data is loaded as floats
+static inline float toFloatSample(int16 sample) noexcept { return sample / 32767.f; }
+
+template <typename SampleType>
+static void gatherSamples(float *current, float *next, const SampleType *source,
+    const int *positions, const int *nextPositions, int numSamples) noexcept
+{
+    for (int i = 0; i < numSamples; ++i)
+    {
+        current[i] = toFloatSample(source[positions[i]]);
+        next[i] = toFloatSample(source[nextPositions[i]]);
+    }
+}
+
+// The linear interpolation between the gathered source samples, with the note
+// gain and the envelope applied, i.e. for each sample:
+// (current * (1 - alpha) + next * alpha) * (noteGain * envelope),
+// with exactly the same operations in the same order as the scalar version
+static void renderInterpolated(float *destination,
+    const float *current, const float *next, const float *alpha,
+    const float *envelope, float noteGain, int numSamples) noexcept
+{
+    int i = 0;
+
+#if JUCE_USE_SSE_INTRINSICS
+
+    const auto one = _mm_set1_ps(1.f);
+    const auto gain = _mm_set1_ps(noteGain);
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto a = _mm_loadu_ps(alpha + i);
+        const auto mixed = _mm_add_ps(
+            _mm_mul_ps(_mm_loadu_ps(current + i), _mm_sub_ps(one, a)),
+            _mm_mul_ps(_mm_loadu_ps(next + i), a));
+        _mm_storeu_ps(destination + i,
+            _mm_mul_ps(mixed, _mm_mul_ps(gain, _mm_loadu_ps(envelope + i))));
+    }
+
+#elif JUCE_USE_ARM_NEON
+
+    // not using vmlaq here, so that the rounding is the same as in the scalar code
+    const auto one = vdupq_n_f32(1.f);
+    const auto gain = vdupq_n_f32(noteGain);
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto a = vld1q_f32(alpha + i);
+        const auto mixed = vaddq_f32(
+            vmulq_f32(vld1q_f32(current + i), vsubq_f32(one, a)),
+            vmulq_f32(vld1q_f32(next + i), a));
+        vst1q_f32(destination + i,
+            vmulq_f32(mixed, vmulq_f32(gain, vld1q_f32(envelope + i))));
+    }
+
+#endif
+
+    for (; i < numSamples; ++i)
+    {
+        const float invAlpha = 1.0f - alpha[i];
+        const float mixed = current[i] * invAlpha + next[i] * alpha[i];
+        destination[i] = mixed * (noteGain * envelope[i]);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Mapped samples prefetching
+//===----------------------------------------------------------------------===//
+
+// Only the attacks of the mapped samples are preloaded, and the rest would be
+// read from disk by page faults on the audio thread; instead, the voices ask
+// this thread to have the system read their samples ahead of their positions;
+// the requests are only hints, so they are dropped if the queue is full or busy,
+// and it doesn't matter if the data is unmapped before a request is handled
+class SoundFontSamplePrefetcher final : private Thread
+{
+public:
+
+    SoundFontSamplePrefetcher() : Thread("SoundFontPrefetch")
+    {
+        this->startThread(6);
+    }
+
+    ~SoundFontSamplePrefetcher() override
+    {
+        this->stopThread(1000);
+    }
+
+    // Never blocks, so it can be called from the audio thread;
+    // returns false if the request was dropped
+    bool prefetch(const SharedMappedSampleData &data, int64 startSample, int64 numSamples) noexcept
+    {
+        const auto start = jlimit(int64(0), int64(data.getNumSamples()), startSample);
+        const auto end = jlimit(start, int64(data.getNumSamples()), startSample + numSamples);
+        if (start == end)
+        {
+            return true;
+        }
+
+        {
+            const SpinLock::ScopedTryLockType lock(this->requestsLock);
+            if (!lock.isLocked() || this->numRequests == maxRequests)
+            {
+                return false;
+            }
+
+            auto &request = this->requests[(this->firstRequest + this->numRequests) % maxRequests];
+            request.data = data.getData() + start * int64(sizeof(int16));
+            request.size = size_t(end - start) * sizeof(int16);
+            this->numRequests++;
+        }
+
+        // not notify(), which locks a mutex: the thread polls this flag
+        this->hasPendingRequests.set(true);
+        return true;
+    }
+
+private:
+
+    void run() override
+    {
+        while (!this->threadShouldExit())
+        {
+            if (!this->hasPendingRequests.exchange(false))
+            {
+                this->wait(pollIntervalMs);
+                continue;
+            }
+
+            Request request;
+            while (!this->threadShouldExit() && this->popRequest(request))
+            {
+                SoundFontSamplePrefetcher::adviseWillNeed(request);
+            }
+        }
+    }
+
+    struct Request final
+    {
+        const char *data = nullptr;
+        size_t size = 0;
+    };
+
+    bool popRequest(Request &outRequest) noexcept
+    {
+        const SpinLock::ScopedLockType lock(this->requestsLock);
+        if (this->numRequests == 0)
+        {
+            return false;
+        }
+
+        outRequest = this->requests[this->firstRequest];
+        this->firstRequest = (this->firstRequest + 1) % maxRequests;
+        this->numRequests--;
+        return true;
+    }
+
+    static void adviseWillNeed(const Request &request) noexcept
+    {
+#if JUCE_LINUX || JUCE_MAC || JUCE_ANDROID || JUCE_IOS
+        // the readahead is asynchronous, and the advice on a range
+        // which is not mapped anymore just fails, harmlessly
+        static const auto pageSize = size_t(sysconf(_SC_PAGESIZE));
+        const auto address = reinterpret_cast<uintptr_t>(request.data);
+        const auto pageStart = address - (address % pageSize);
+        madvise(reinterpret_cast<void *>(pageStart),
+            size_t(address - pageStart) + request.size, MADV_WILLNEED);
+#else
+        // elsewhere, the voices rely on the attacks preloaded by the loader
+        ignoreUnused(request);
+#endif
+    }
+
+    // enough for all voices of a couple of synths
+    static constexpr auto maxRequests = 1024;
+
+    // way less than it takes to play through the prefetch window
+    static constexpr auto pollIntervalMs = 5;
+
+    Atomic<bool> hasPendingRequests = false;
+
+    SpinLock requestsLock;
+    Request requests[maxRequests];
+    int firstRequest = 0;
+    int numRequests = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontSamplePrefetcher)
+};
+
 //===----------------------------------------------------------------------===//
 // SoundFontVoice
 //===----------------------------------------------------------------------===//
@@ -340,8 +544,22 @@ private:
     void calcPitchRatio();
     void killNote();
 
+    // requests the next window of the mapped sample data,
+    // when the voice gets closer than a half window to its end
+    void prefetchAhead(const SharedMappedSampleData &data);
+    int64 prefetchedUntil = 0;
+    static constexpr int64 prefetchWindowSize = 32768;
+
+    SharedResourcePointer<SoundFontSamplePrefetcher> prefetcher;
+
     static constexpr float globalGainDB = -0.1f;
 
+    // the block is rendered in chunks of up to this size,
+    // see the comment in renderNextBlock
+    static constexpr auto renderChunkSize = 64;
+
+    friend class SoundFontVoiceRenderingTests;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontVoice)
 };
 
@@ -379,7 +597,7 @@ void SoundFontVoice::startNote(int midiNoteNumber, float floatVelocity,
 
     if ((this->region == nullptr) ||
         (this->region->sample == nullptr) ||
-        (this->region->sample->getBuffer() == nullptr))
+        !this->region->sample->hasData())
     {
         this->killNote();
         return;
@@ -451,6 +669,12 @@ void SoundFontVoice::startNote(int midiNoteNumber, float floatVelocity,
     }
 
     this->numLoops = 0;
+
+    if (const auto *mappedData = this->region->sample->getMappedData())
+    {
+        this->prefetchedUntil = 0;
+        this->prefetchAhead(*mappedData);
+    }
 }
 
 void SoundFontVoice::stopNote(float /*velocity*/, bool allowTailOff)
@@ -507,20 +731,29 @@ void SoundFontVoice::renderNextBlock(AudioSampleBuffer &outputBuffer, int startS
         return;
     }
 
+    // the sample data is either a float buffer, or the mapped 16-bit mono data
     const auto *buffer = this->region->sample->getBuffer();
-    if (buffer == nullptr)
+    const auto *mappedData = this->region->sample->getMappedData();
+    if (buffer == nullptr && mappedData == nullptr)
     {
         jassertfalse;
         return;
     }
 
-    const float *inL = buffer->getReadPointer(0, 0);
-    const float *inR = buffer->getNumChannels() > 1 ? buffer->getReadPointer(1, 0) : nullptr;
+    const float *inL = buffer != nullptr ? buffer->getReadPointer(0, 0) : nullptr;
+    const float *inR = (buffer != nullptr && buffer->getNumChannels() > 1) ?
+        buffer->getReadPointer(1, 0) : nullptr;
+    const int16 *inMapped = mappedData != nullptr ? mappedData->getSamples() : nullptr;
+    if (mappedData != nullptr)
+    {
+        this->prefetchAhead(*mappedData);
+    }
 
     float *outL = outputBuffer.getWritePointer(0, startSample);
     float *outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
 
-    const int bufferNumSamples = buffer->getNumSamples();
+    const int bufferNumSamples = buffer != nullptr ?
+        buffer->getNumSamples() : mappedData->getNumSamples();
 
     // Cache some values, to give them at least some chance of ending up in registers.
     double sourceSamplePosition = this->sourceSamplePosition;
@@ -533,72 +766,124 @@ void SoundFontVoice::renderNextBlock(AudioSampleBuffer &outputBuffer, int startS
     const float loopEnd = float(this->loopEnd);
     const float sampleEnd = float(this->sampleEnd);
 
-    while (--numSamples >= 0)
+    // The block is rendered chunk by chunk, in three passes: the first one is scalar,
+    // it steps the source position and the envelope, which are sequential by nature,
+    // handles the loop wraps and the envelope segment changes, collects the source
+    // sample positions, and ends the chunk early if the note ends; the second one
+    // gathers the source samples, converting them to floats if needed; the last one has
+    // no branches, and does the interpolation, the gains and the mixing
+    // in SIMD; it's the same maths in the same order as it was per sample,
+    // so the output doesn't change, see SoundFontVoiceRenderingTests
+    int positions[SoundFontVoice::renderChunkSize];
+    int nextPositions[SoundFontVoice::renderChunkSize];
+    alignas(16) float currentL[SoundFontVoice::renderChunkSize];
+    alignas(16) float nextL[SoundFontVoice::renderChunkSize];
+    alignas(16) float currentR[SoundFontVoice::renderChunkSize];
+    alignas(16) float nextR[SoundFontVoice::renderChunkSize];
+    alignas(16) float alpha[SoundFontVoice::renderChunkSize];
+    alignas(16) float envelopeGain[SoundFontVoice::renderChunkSize];
+    alignas(16) float renderedL[SoundFontVoice::renderChunkSize];
+    alignas(16) float renderedR[SoundFontVoice::renderChunkSize];
+
+    bool noteHasEnded = false;
+    while (numSamples > 0 && !noteHasEnded)
     {
-        const int pos = int(sourceSamplePosition);
-        jassert(pos >= 0 && pos < bufferNumSamples);
-        const float alpha = float(sourceSamplePosition - pos);
-        const float invAlpha = 1.0f - alpha;
-        int nextPos = pos + 1;
-        if ((loopStart < loopEnd) && (nextPos > loopEnd))
+        const int chunkSize = jmin(numSamples, SoundFontVoice::renderChunkSize);
+        int numChunkSamples = 0;
+
+        while (numChunkSamples < chunkSize)
         {
-            nextPos = int(loopStart);
-        }
+            const int pos = int(sourceSamplePosition);
+            jassert(pos >= 0 && pos < bufferNumSamples);
+            int nextPos = pos + 1;
+            if ((loopStart < loopEnd) && (nextPos > loopEnd))
+            {
+                nextPos = int(loopStart);
+            }
 
-        // Simple linear interpolation with buffer overrun check
-        const float nextL = nextPos < bufferNumSamples ? inL[nextPos] : inL[pos];
-        const float nextR = inR ? (nextPos < bufferNumSamples ? inR[nextPos] : inR[pos]) : nextL;
-        float l = (inL[pos] * invAlpha + nextL * alpha);
-        float r = inR ? (inR[pos] * invAlpha + nextR * alpha) : l;
+            // Simple linear interpolation with buffer overrun check
+            const int i = numChunkSamples++;
+            alpha[i] = float(sourceSamplePosition - pos);
+            positions[i] = pos;
+            nextPositions[i] = nextPos < bufferNumSamples ? nextPos : pos;
+            envelopeGain[i] = ampegGain;
 
-        const float gainLeft = this->noteGainLeft * ampegGain;
-        const float gainRight = this->noteGainRight * ampegGain;
-        l *= gainLeft;
-        r *= gainRight;
-        // Shouldn't we dither here?
+            // Next sample.
+            sourceSamplePosition += this->pitchRatio;
+            if ((loopStart < loopEnd) && (sourceSamplePosition > loopEnd))
+            {
+                sourceSamplePosition = loopStart;
+                this->numLoops += 1;
+            }
 
-        if (outR)
+            // Update EG.
+            if (ampSegmentIsExponential)
+            {
+                ampegGain *= ampegSlope;
+            }
+            else
+            {
+                ampegGain += ampegSlope;
+            }
+            if (--samplesUntilNextAmpSegment < 0)
+            {
+                this->envelope.setLevel(ampegGain);
+                this->envelope.nextSegment();
+                ampegGain = this->envelope.getLevel();
+                ampegSlope = this->envelope.getSlope();
+                samplesUntilNextAmpSegment = this->envelope.getSamplesUntilNextSegment();
+                ampSegmentIsExponential = this->envelope.getSegmentIsExponential();
+            }
+
+            if ((sourceSamplePosition >= sampleEnd) || this->envelope.isDone())
+            {
+                noteHasEnded = true;
+                break;
+            }
+        }
+
+        if (inMapped != nullptr)
         {
-            *outL++ += l;
-            *outR++ += r;
+            gatherSamples(currentL, nextL, inMapped, positions, nextPositions, numChunkSamples);
         }
         else
         {
-            *outL++ += (l + r) * 0.5f;
+            gatherSamples(currentL, nextL, inL, positions, nextPositions, numChunkSamples);
+            if (inR)
+            {
+                gatherSamples(currentR, nextR, inR, positions, nextPositions, numChunkSamples);
+            }
         }
 
-        // Next sample.
-        sourceSamplePosition += this->pitchRatio;
-        if ((loopStart < loopEnd) && (sourceSamplePosition > loopEnd))
-        {
-            sourceSamplePosition = loopStart;
-            this->numLoops += 1;
-        }
+        // for the mono samples, the right channel is the same as the left one,
+        // only with the right channel's gain
+        renderInterpolated(renderedL, currentL, nextL,
+            alpha, envelopeGain, this->noteGainLeft, numChunkSamples);
+        renderInterpolated(renderedR, inR ? currentR : currentL, inR ? nextR : nextL,
+            alpha, envelopeGain, this->noteGainRight, numChunkSamples);
+        // Shouldn't we dither here?
 
-        // Update EG.
-        if (ampSegmentIsExponential)
+        if (outR)
         {
-            ampegGain *= ampegSlope;
+            FloatVectorOperations::add(outL, renderedL, numChunkSamples);
+            FloatVectorOperations::add(outR, renderedR, numChunkSamples);
+            outR += numChunkSamples;
         }
         else
         {
-            ampegGain += ampegSlope;
-        }
-        if (--samplesUntilNextAmpSegment < 0)
-        {
-            this->envelope.setLevel(ampegGain);
-            this->envelope.nextSegment();
-            ampegGain = this->envelope.getLevel();
-            ampegSlope = this->envelope.getSlope();
-            samplesUntilNextAmpSegment = this->envelope.getSamplesUntilNextSegment();
-            ampSegmentIsExponential = this->envelope.getSegmentIsExponential();
+            // the multiplication by 0.5 is exact, so it doesn't matter
+            // if the platform's implementation fuses it with the addition
+            FloatVectorOperations::add(renderedL, renderedR, numChunkSamples);
+            FloatVectorOperations::addWithMultiply(outL, renderedL, 0.5f, numChunkSamples);
         }
 
-        if ((sourceSamplePosition >= sampleEnd) || this->envelope.isDone())
-        {
-            this->killNote();
-            break;
-        }
+        outL += numChunkSamples;
+        numSamples -= numChunkSamples;
+    }
+
+    if (noteHasEnded)
+    {
+        this->killNote();
     }
 
     this->sourceSamplePosition = sourceSamplePosition;
@@ -670,6 +955,23 @@ void SoundFontVoice::calcPitchRatio()
         (naturalFreq * this->getSampleRate());
 }
 
+void SoundFontVoice::prefetchAhead(const SharedMappedSampleData &data)
+{
+    // after the loop wraps, the position goes back
+    // into the range which has already been prefetched
+    const auto position = int64(this->sourceSamplePosition);
+    if (position + SoundFontVoice::prefetchWindowSize / 2 < this->prefetchedUntil)
+    {
+        return;
+    }
+
+    const auto start = jmax(position, this->prefetchedUntil);
+    if (this->prefetcher->prefetch(data, start, SoundFontVoice::prefetchWindowSize))
+    {
+        this->prefetchedUntil = start + SoundFontVoice::prefetchWindowSize;
+    }
+}
+
 void SoundFontVoice::killNote()
 {
     this->region = nullptr;
@@ -680,6 +982,87 @@ void SoundFontVoice::killNote()
 // SoundFontSynth
 //===----------------------------------------------------------------------===//
 
+class SoundFontSynth::LoadingThreadPool final : public ThreadPool
+{
+public:
+
+    // shared by all synths, so that opening a project with many instruments
+    // doesn't start a thread per instrument
+    LoadingThreadPool() : ThreadPool(2) {}
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoadingThreadPool)
+};
+
+class SoundFontSynth::LoadingJob final : public ThreadPoolJob
+{
+public:
+
+    LoadingJob(SoundFontSynth &synthIn, const File &fileIn) :
+        ThreadPoolJob("SoundFontLoading"),
+        synth(synthIn),
+        file(fileIn) {}
+
+    JobStatus runJob() override
+    {
+        const auto fullPath = this->file.getFullPathName();
+
+        UniquePointer<SoundFontSound> sound;
+        if (fullPath.endsWithIgnoreCase("sf2"))
+        {
+            sound = make<SoundFont2Sound>(this->file);
+        }
+        else if (fullPath.endsWithIgnoreCase("sf3") || fullPath.endsWithIgnoreCase("sf4"))
+        {
+            sound = make<SoundFont3Sound>(this->file);
+        }
+        else if (fullPath.endsWithIgnoreCase("sbk"))
+        {
+            sound = make<SoundFontSound>(this->file);
+        }
+
+        if (sound != nullptr)
+        {
+            // the progress is only reported per stage,
+            // the samples loading takes most of the time
+            sound->loadRegions();
+            if (this->shouldExit())
+            {
+                return jobHasFinished;
+            }
+
+            this->synth.loadingProgress = 0.25f;
+
+            AudioFormatManager audioFormatManager;
+            audioFormatManager.registerBasicFormats();
+            sound->loadSamples(audioFormatManager,
+                [this]() { return this->shouldExit(); });
+            if (this->shouldExit())
+            {
+                return jobHasFinished;
+            }
+
+            this->synth.loadingProgress = 0.9f;
+        }
+
+        this->synth.finishLoading(move(sound));
+        return jobHasFinished;
+    }
+
+private:
+
+    SoundFontSynth &synth;
+    const File file;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoadingJob)
+};
+
+SoundFontSynth::SoundFontSynth() = default;
+
+SoundFontSynth::~SoundFontSynth()
+{
+    this->cancelLoading();
+}
+
 void SoundFontSynth::initSynth(const Parameters &parameters)
 {
     File file(parameters.filePath);
@@ -693,52 +1076,90 @@ void SoundFontSynth::initSynth(const Parameters &parameters)
         }
     }
 
-    const ScopedLock locker(this->lock);
-
-    this->allNotesOff(0, false);
+    // waits for the previous loading, if any, to notice that it should exit,
+    // so it must not be called while holding the lock
+    this->cancelLoading();
 
-    this->clearVoices();
-    for (int i = SoundFontSynth::numVoices; i --> 0 ;)
     {
-        auto voice = make<SoundFontVoice>();
-        voice->setTemperament(this->temperament);
-        this->addVoice(voice.release());
+        const ScopedLock locker(this->lock);
+        this->requestedProgram = parameters.programIndex;
+        this->loadingProgress = 0.f;
     }
 
-    this->clearSounds();
+    this->loadingJob = make<LoadingJob>(*this, file);
+    this->loadingThreadPool->addJob(this->loadingJob.get(), false);
+}
 
-    AudioFormatManager audioFormatManager;
-    audioFormatManager.registerBasicFormats();
+void SoundFontSynth::finishLoading(UniquePointer<SoundFontSound> &&sound)
+{
+    SynthesiserSound::Ptr previousSound;
+    OwnedArray<SynthesiserVoice> previousVoices;
 
-    const auto fullPath = file.getFullPathName();
-    if (fullPath.endsWithIgnoreCase("sf2"))
     {
-        auto sound = make<SoundFont2Sound>(file);
-        sound->loadRegions();
-        sound->loadSamples(audioFormatManager);
-        sound->setTemperament(this->temperament);
-        this->sounds.add(sound.release());
+        const ScopedLock locker(this->lock);
+
+        this->allNotesOff(0, false);
+
+        previousVoices.swapWith(this->voices);
+        for (int i = SoundFontSynth::numVoices; i --> 0 ;)
+        {
+            auto voice = make<SoundFontVoice>();
+            voice->setTemperament(this->temperament);
+            this->addVoice(voice.release());
+        }
+
+        if (this->getNumSounds() > 0)
+        {
+            previousSound = this->getSound(0);
+        }
+
+        this->clearSounds();
+
+        if (sound != nullptr)
+        {
+            // new file has been loaded so we need to set the program anyway
+            sound->setTemperament(this->temperament);
+            sound->setSelectedPreset(isPositiveAndBelow(this->requestedProgram,
+                sound->getNumPresets()) ? this->requestedProgram : 0);
+
+            this->sounds.add(sound.release());
+        }
+
+        this->loadingProgress = 1.f;
     }
-    else if (fullPath.endsWithIgnoreCase("sf3") || fullPath.endsWithIgnoreCase("sf4"))
+
+    // the previous sound is released here, after unlocking, not on the audio thread,
+    // so that freeing its samples doesn't block the audio callback
+    previousSound = nullptr;
+    previousVoices.clear();
+
+    if (this->onSoundLoaded != nullptr)
     {
-        auto sound = make<SoundFont3Sound>(file);
-        sound->loadRegions();
-        sound->loadSamples(audioFormatManager);
-        sound->setTemperament(this->temperament);
-        this->sounds.add(sound.release());
+        this->onSoundLoaded();
     }
-    else if (fullPath.endsWithIgnoreCase("sbk"))
+}
+
+void SoundFontSynth::cancelLoading()
+{
+    if (this->loadingJob != nullptr)
     {
-        auto sound = make<SoundFontSound>(file);
-        sound->loadRegions();
-        sound->loadSamples(audioFormatManager);
-        sound->setTemperament(this->temperament);
-        this->sounds.add(sound.release());
+        // the job checks shouldExit() between the chunks of the samples
+        // loading and decompression, so this only waits for the current chunk
+        this->loadingThreadPool->removeJob(this->loadingJob.get(), true, -1);
+        this->loadingJob = nullptr;
     }
 
-    // new file has been loaded so we need to set the program anyway
-    jassert(parameters.programIndex < this->getNumPrograms());
-    this->setCurrentProgram(parameters.programIndex);
+    this->loadingProgress = 1.f;
+}
+
+bool SoundFontSynth::isLoading() const noexcept
+{
+    return this->loadingProgress.get() < 1.f;
+}
+
+float SoundFontSynth::getLoadingProgress() const noexcept
+{
+    return this->loadingProgress.get();
 }
 
 void SoundFontSynth::noteOn(int midiChannel, int midiNoteNumber, float velocity)
@@ -812,9 +1233,8 @@ void SoundFontSynth::noteOn(int midiChannel, int midiNoteNumber, float velocity)
         const auto trigger = anyNotesPlaying ?
             SoundFontRegion::Trigger::legato : SoundFontRegion::Trigger::first;
 
-        for (int i = 0; i < sound->getNumRegions(); ++i)
+        for (auto *region : sound->getRegionsFor(actualNoteNumber, midiVelocity))
         {
-            auto *region = sound->regionAt(i);
             if (region->matches(actualNoteNumber, midiVelocity, trigger, periodSize))
             {
                 if (auto *voice = dynamic_cast<SoundFontVoice *>(this->findFreeVoice(sound,
@@ -885,6 +1305,8 @@ void SoundFontSynth::noteOff(int midiChannel, int midiNoteNumber, float velocity
 
 int SoundFontSynth::getNumPrograms() const
 {
+    const ScopedLock locker(this->lock);
+
     if (auto *sound = this->getSoundFontSound())
     {
         return sound->getNumPresets();
@@ -895,6 +1317,8 @@ int SoundFontSynth::getNumPrograms() const
 
 int SoundFontSynth::getCurrentProgram() const
 {
+    const ScopedLock locker(this->lock);
+
     if (auto *sound = this->getSoundFontSound())
     {
         return sound->getSelectedPreset();
@@ -905,6 +1329,15 @@ int SoundFontSynth::getCurrentProgram() const
 
 void SoundFontSynth::setCurrentProgram(int index)
 {
+    const ScopedLock locker(this->lock);
+
+    if (this->isLoading())
+    {
+        // will be selected when the new sound is loaded
+        this->requestedProgram = index;
+        return;
+    }
+
     if (auto *sound = this->getSoundFontSound())
     {
         return sound->setSelectedPreset(index < this->getNumPrograms() ? index : 0);
@@ -913,6 +1346,8 @@ void SoundFontSynth::setCurrentProgram(int index)
 
 const String SoundFontSynth::getProgramName(int index) const
 {
+    const ScopedLock locker(this->lock);
+
     if (auto *sound = this->getSoundFontSound())
     {
         return sound->getPresetName(index);
@@ -928,6 +1363,8 @@ void SoundFontSynth::changeProgramName(int index, const String &newName)
 
 void SoundFontSynth::setTemperament(Temperament::Ptr temperament)
 {
+    const ScopedLock locker(this->lock);
+
     if (this->temperament == temperament)
     {
         return;
@@ -1011,3 +1448,269 @@ void SoundFontSynth::Parameters::reset()
     this->filePath.clear();
     this->programIndex = 0;
 }
+
+#if JUCE_UNIT_TESTS
+
+class SoundFontVoiceRenderingTests final : public UnitTest
+{
+public:
+
+    SoundFontVoiceRenderingTests() :
+        UnitTest("SoundFont voice rendering tests", UnitTestCategories::helio) {}
+
+    void runTest() override
+    {
+        beginTest("Vectorised interpolation matches the scalar one");
+
+        constexpr auto maxSize = 67; // not a multiple of the vector size
+        float current[maxSize], next[maxSize], alpha[maxSize], envelope[maxSize];
+        float rendered[maxSize];
+
+        auto random = this->getRandom();
+        for (int numSamples = 0; numSamples <= maxSize; ++numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                current[i] = random.nextFloat() * 2.f - 1.f;
+                next[i] = random.nextFloat() * 2.f - 1.f;
+                alpha[i] = random.nextFloat();
+                envelope[i] = random.nextFloat();
+            }
+
+            const auto noteGain = random.nextFloat();
+            renderInterpolated(rendered, current, next, alpha, envelope, noteGain, numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                // the way it used to be computed per sample
+                const float invAlpha = 1.0f - alpha[i];
+                float expected = (current[i] * invAlpha + next[i] * alpha[i]);
+                expected *= noteGain * envelope[i];
+
+                // exactly the same, unless the compiler fuses the scalar code
+                expectWithinAbsoluteError(rendered[i], expected, 1.0e-6f);
+            }
+        }
+
+        for (const auto isLooped : { true, false })
+        {
+            for (const auto numSourceChannels : { 1, 2 })
+            {
+                for (const auto numOutputChannels : { 1, 2 })
+                {
+                    beginTest("Chunked voice rendering matches the per-sample one, " +
+                        String(isLooped ? "looped, " : "not looped, ") +
+                        String(numSourceChannels) + " to " + String(numOutputChannels) + " channels");
+
+                    this->testVoiceRendering(isLooped, numSourceChannels, numOutputChannels);
+                }
+            }
+        }
+    }
+
+private:
+
+    void testVoiceRendering(bool isLooped, int numSourceChannels, int numOutputChannels)
+    {
+        constexpr auto sampleRate = 44100.0;
+        constexpr auto numRenderedSamples = 4000;
+
+        // the looped note is released, and it ends when the envelope is done,
+        // the other one ends when it runs out of the sample data
+        const auto noteOffSample = isLooped ? 2500 : numRenderedSamples;
+        const auto numSourceSamples = isLooped ? 5000 : 700;
+
+        auto random = this->getRandom();
+
+        SoundFontSample sample(sampleRate);
+        SharedAudioSampleBuffer::Ptr sampleData(new SharedAudioSampleBuffer(numSourceChannels, numSourceSamples));
+        for (int channel = 0; channel < numSourceChannels; ++channel)
+        {
+            for (int i = 0; i < numSourceSamples; ++i)
+            {
+                sampleData->setSample(channel, i, random.nextFloat() * 2.f - 1.f);
+            }
+        }
+
+        sample.setBuffer(sampleData);
+
+        // the envelope's segments and the loop wraps
+        // are all over the place relative to the chunks
+        SoundFontRegion region;
+        region.sample = &sample;
+        region.pan = 30.f;
+        region.ampeg.attack = 0.003f;
+        region.ampeg.hold = 0.002f;
+        region.ampeg.decay = 0.02f;
+        region.ampeg.sustain = 40.f;
+        region.ampeg.release = 0.004f;
+        region.loopMode = isLooped ?
+            SoundFontRegion::LoopMode::loopContinuous :
+            SoundFontRegion::LoopMode::noLoop;
+        region.loopStart = 200;
+        region.loopEnd = 500;
+
+        Synthesiser synth;
+        auto *voice = new SoundFontVoice();
+        voice->setTemperament(Temperament::makeTwelveToneEqualTemperament());
+        voice->setRegion(&region);
+        synth.addVoice(voice);
+        synth.addSound(new SoundFontSound(File()));
+        synth.setCurrentPlaybackSampleRate(sampleRate);
+
+        // not the key center, so that the source positions are fractional
+        synth.noteOn(1, 62, 1.f);
+        expect(voice->isVoiceActive());
+
+        AudioBuffer<float> expected(numOutputChannels, numRenderedSamples);
+        AudioBuffer<float> rendered(numOutputChannels, numRenderedSamples);
+        for (int channel = 0; channel < numOutputChannels; ++channel)
+        {
+            for (int i = 0; i < numRenderedSamples; ++i)
+            {
+                const auto existingSample = random.nextFloat() * 0.1f;
+                expected.setSample(channel, i, existingSample);
+                rendered.setSample(channel, i, existingSample);
+            }
+        }
+
+        const auto numExpectedSamples = renderPerSample(expected,
+            *sampleData, region, *voice, sampleRate, noteOffSample);
+        expect(numExpectedSamples < numRenderedSamples);
+
+        // odd block sizes, so that the blocks are split into
+        // full and partial chunks, and the chunks are cut by the note end
+        static const int blockSizes[] = { 1, 63, 64, 65, 200, 17, 128 };
+        int blockIndex = 0;
+        for (int start = 0; start < numRenderedSamples;)
+        {
+            if (start == noteOffSample)
+            {
+                voice->stopNote(1.f, true);
+            }
+
+            const auto nextStop = start < noteOffSample ? noteOffSample : numRenderedSamples;
+            const auto blockSize = jmin(nextStop - start,
+                blockSizes[blockIndex++ % numElementsInArray(blockSizes)]);
+
+            voice->renderNextBlock(rendered, start, blockSize);
+            start += blockSize;
+        }
+
+        expect(!voice->isVoiceActive());
+
+        for (int channel = 0; channel < numOutputChannels; ++channel)
+        {
+            for (int i = 0; i < numRenderedSamples; ++i)
+            {
+                expectWithinAbsoluteError(rendered.getSample(channel, i),
+                    expected.getSample(channel, i), 1.0e-6f);
+            }
+        }
+    }
+
+    // The way the voice used to render, sample by sample, into the whole buffer,
+    // with the same parameters as the voice has got when its note started;
+    // returns the number of samples until the note has ended
+    static int renderPerSample(AudioBuffer<float> &output,
+        const AudioBuffer<float> &source, const SoundFontRegion &region,
+        const SoundFontVoice &voice, double sampleRate, int noteOffSample)
+    {
+        SoundFontEnvelope envelope;
+        envelope.setExponentialDecay(true);
+        envelope.startNote(&region.ampeg, 1.f, sampleRate, &region.ampegVelTrack);
+
+        double sourceSamplePosition = voice.sourceSamplePosition;
+        float ampegGain = envelope.getLevel();
+        float ampegSlope = envelope.getSlope();
+        int samplesUntilNextAmpSegment = envelope.getSamplesUntilNextSegment();
+        bool ampSegmentIsExponential = envelope.getSegmentIsExponential();
+
+        const float loopStart = float(voice.loopStart);
+        const float loopEnd = float(voice.loopEnd);
+        const float sampleEnd = float(voice.sampleEnd);
+
+        const auto bufferNumSamples = source.getNumSamples();
+        const auto *inL = source.getReadPointer(0);
+        const auto *inR = source.getNumChannels() > 1 ? source.getReadPointer(1) : nullptr;
+        auto *outL = output.getWritePointer(0);
+        auto *outR = output.getNumChannels() > 1 ? output.getWritePointer(1) : nullptr;
+
+        for (int n = 0; n < output.getNumSamples(); ++n)
+        {
+            if (n == noteOffSample)
+            {
+                envelope.setLevel(ampegGain);
+                envelope.setSamplesUntilNextSegment(samplesUntilNextAmpSegment);
+                envelope.noteOff();
+                ampegGain = envelope.getLevel();
+                ampegSlope = envelope.getSlope();
+                samplesUntilNextAmpSegment = envelope.getSamplesUntilNextSegment();
+                ampSegmentIsExponential = envelope.getSegmentIsExponential();
+            }
+
+            const int pos = int(sourceSamplePosition);
+            const float alpha = float(sourceSamplePosition - pos);
+            const float invAlpha = 1.0f - alpha;
+            int nextPos = pos + 1;
+            if ((loopStart < loopEnd) && (nextPos > loopEnd))
+            {
+                nextPos = int(loopStart);
+            }
+
+            const float nextL = nextPos < bufferNumSamples ? inL[nextPos] : inL[pos];
+            const float nextR = inR ? (nextPos < bufferNumSamples ? inR[nextPos] : inR[pos]) : nextL;
+            float l = (inL[pos] * invAlpha + nextL * alpha);
+            float r = inR ? (inR[pos] * invAlpha + nextR * alpha) : l;
+
+            l *= voice.noteGainLeft * ampegGain;
+            r *= voice.noteGainRight * ampegGain;
+
+            if (outR)
+            {
+                *outL++ += l;
+                *outR++ += r;
+            }
+            else
+            {
+                *outL++ += (l + r) * 0.5f;
+            }
+
+            sourceSamplePosition += voice.pitchRatio;
+            if ((loopStart < loopEnd) && (sourceSamplePosition > loopEnd))
+            {
+                sourceSamplePosition = loopStart;
+            }
+
+            if (ampSegmentIsExponential)
+            {
+                ampegGain *= ampegSlope;
+            }
+            else
+            {
+                ampegGain += ampegSlope;
+            }
+
+            if (--samplesUntilNextAmpSegment < 0)
+            {
+                envelope.setLevel(ampegGain);
+                envelope.nextSegment();
+                ampegGain = envelope.getLevel();
+                ampegSlope = envelope.getSlope();
+                samplesUntilNextAmpSegment = envelope.getSamplesUntilNextSegment();
+                ampSegmentIsExponential = envelope.getSegmentIsExponential();
+            }
+
+            if ((sourceSamplePosition >= sampleEnd) || envelope.isDone())
+            {
+                return n + 1;
+            }
+        }
+
+        return output.getNumSamples();
+    }
+};
+
+static SoundFontVoiceRenderingTests soundFontVoiceRenderingTests;
+
+#endif
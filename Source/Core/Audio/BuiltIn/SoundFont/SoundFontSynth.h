@@ -29,13 +29,16 @@ class SoundFontSynth final : public Synthesiser
 {
 public:
 
-    SoundFontSynth() = default;
+    SoundFontSynth();
+    ~SoundFontSynth() override;
 
     void setTemperament(Temperament::Ptr temperament);
 
     void noteOn(int midiChannel, int midiNoteNumber, float velocity) override;
     void noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override;
 
+    // The sound is swapped by the loading thread,
+    // so this must only be called while holding the lock
     inline SoundFontSound *getSoundFontSound() const noexcept;
 
     //===------------------------------------------------------------------===//
@@ -55,8 +58,17 @@ public:
         void reset() override;
     };
 
+    // Starts loading the SoundFont on a background thread and returns immediately;
+    // until it's loaded, the previous sound (if any) keeps playing, and then
+    // the new one is swapped in, see onSoundLoaded
     void initSynth(const Parameters &parameters);
 
+    bool isLoading() const noexcept;
+    float getLoadingProgress() const noexcept;
+
+    // Called from the loading thread, when the new sound has been swapped in
+    Function<void()> onSoundLoaded;
+
     //===------------------------------------------------------------------===//
     // Presets
     //===------------------------------------------------------------------===//
@@ -76,5 +88,25 @@ private:
 
     Temperament::Ptr temperament;
 
+    //===------------------------------------------------------------------===//
+    // Loading
+    //===------------------------------------------------------------------===//
+
+    class LoadingJob;
+    class LoadingThreadPool;
+
+    // Replaces the sound and the voices, or just clears them if the sound is null
+    void finishLoading(UniquePointer<SoundFontSound> &&sound);
+    void cancelLoading();
+
+    SharedResourcePointer<LoadingThreadPool> loadingThreadPool;
+    UniquePointer<LoadingJob> loadingJob;
+
+    // 1 when not loading
+    Atomic<float> loadingProgress { 1.f };
+
+    // the program to select when the sound is loaded, guarded by the lock
+    int requestedProgram = 0;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontSynth)
 };
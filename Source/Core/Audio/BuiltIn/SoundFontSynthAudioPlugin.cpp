@@ -33,7 +33,7 @@ const String SoundFontSynthAudioPlugin::instrumentName = "SoundFont Player";
 // A simple UI allowing to pick a file and switch between presets, if any
 //===----------------------------------------------------------------------===//
 
-class SoundFontSynthEditor final : public AudioProcessorEditor
+class SoundFontSynthEditor final : public AudioProcessorEditor, private Timer
 {
 public:
 
@@ -68,9 +68,10 @@ public:
 
     void syncDataWithAudioPlugin()
     {
+        const auto isLoading = this->audioPlugin->isLoading();
         const auto numPrograms = this->audioPlugin->getNumPrograms();
         const auto currentProgram = this->audioPlugin->getCurrentProgram();
-        const bool hasPresetSelection = numPrograms > 1;
+        const bool hasPresetSelection = numPrograms > 1 && !isLoading;
 
         this->leftArrow->setVisible(hasPresetSelection);
         this->leftArrow->setEnabled(currentProgram > 0);
@@ -82,7 +83,16 @@ public:
         this->programIndexIndicator->setNumModes(numPrograms);
         this->programIndexIndicator->setCurrentMode(currentProgram);
 
-        this->programNameLabel->setText(this->audioPlugin->getCurrentProgramName(), dontSendNotification);
+        if (isLoading)
+        {
+            this->updateLoadingProgress();
+            this->startTimer(100);
+        }
+        else
+        {
+            this->stopTimer();
+            this->programNameLabel->setText(this->audioPlugin->getCurrentProgramName(), dontSendNotification);
+        }
 
         const auto synthParams = this->audioPlugin->getSynthParameters();
         if (synthParams.filePath.isNotEmpty())
@@ -180,6 +190,24 @@ public:
 
 private:
 
+    void timerCallback() override
+    {
+        if (this->audioPlugin->isLoading())
+        {
+            this->updateLoadingProgress();
+        }
+        else
+        {
+            this->syncDataWithAudioPlugin();
+        }
+    }
+
+    void updateLoadingProgress()
+    {
+        const auto percent = roundToInt(this->audioPlugin->getLoadingProgress() * 100.f);
+        this->programNameLabel->setText(String(percent) + "%", dontSendNotification);
+    }
+
     WeakReference<SoundFontSynthAudioPlugin> audioPlugin;
 
     // soundfont file picker
@@ -205,6 +233,20 @@ private:
 SoundFontSynthAudioPlugin::SoundFontSynthAudioPlugin()
 {
     this->setPlayConfigDetails(0, 2, this->getSampleRate(), this->getBlockSize());
+
+    // called from the loading thread, and the plugin may be gone
+    // by the time the message thread gets to it
+    WeakReference<SoundFontSynthAudioPlugin> weakThis(this);
+    this->synth.onSoundLoaded = [weakThis]()
+    {
+        MessageManager::callAsync([weakThis]()
+        {
+            if (weakThis != nullptr)
+            {
+                weakThis->onSoundLoaded();
+            }
+        });
+    };
 }
 
 void SoundFontSynthAudioPlugin::fillInPluginDescription(PluginDescription &description) const
@@ -329,8 +371,33 @@ void SoundFontSynthAudioPlugin::applySynthParameters(const SoundFontSynth::Param
     }
 
     this->synthParameters = newParameters;
-    // the program # could have been reset to 0 if it was incorrect
+
+    // the program # could have been reset to 0 if it was incorrect,
+    // and if the sound is still loading, see onSoundLoaded
+    if (!this->synth.isLoading())
+    {
+        this->synthParameters.programIndex = this->getCurrentProgram();
+    }
+}
+
+void SoundFontSynthAudioPlugin::onSoundLoaded()
+{
     this->synthParameters.programIndex = this->getCurrentProgram();
+
+    if (auto *editor = dynamic_cast<SoundFontSynthEditor *>(this->getActiveEditor()))
+    {
+        editor->syncDataWithAudioPlugin();
+    }
+}
+
+bool SoundFontSynthAudioPlugin::isLoading() const noexcept
+{
+    return this->synth.isLoading();
+}
+
+float SoundFontSynthAudioPlugin::getLoadingProgress() const noexcept
+{
+    return this->synth.getLoadingProgress();
 }
 
 const SoundFontSynth::Parameters &SoundFontSynthAudioPlugin::getSynthParameters() const noexcept
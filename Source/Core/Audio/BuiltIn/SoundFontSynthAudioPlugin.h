@@ -83,8 +83,13 @@ public:
     void applySynthParameters(const SoundFontSynth::Parameters &params);
     const SoundFontSynth::Parameters &getSynthParameters() const noexcept;
 
+    bool isLoading() const noexcept;
+    float getLoadingProgress() const noexcept;
+
 private:
 
+    void onSoundLoaded();
+
     SoundFontSynth synth;
     SoundFontSynth::Parameters synthParameters;
 
@@ -23,6 +23,7 @@
 #include "SerializationKeys.h"
 #include "DefaultSynthAudioPlugin.h"
 #include "MetronomeSynthAudioPlugin.h"
+#include "SoundFontSynthAudioPlugin.h"
 #include "BuiltInSynthsPluginFormat.h"
 #include "KeyboardMapping.h"
 #include "Workspace.h"
@@ -262,6 +263,23 @@ UniquePointer<ScopedDPIAwarenessDisabler> Instrument::makeDPIAwarenessDisabler(c
 // Nodes
 //===----------------------------------------------------------------------===//
 
+float Instrument::getLoadingProgress() const
+{
+    int numSynths = 0;
+    float progress = 0.f;
+
+    for (int i = 0; i < this->getNumNodes(); ++i)
+    {
+        if (auto *synth = dynamic_cast<SoundFontSynthAudioPlugin *>(this->getNode(i)->getProcessor()))
+        {
+            progress += synth->getLoadingProgress();
+            numSynths++;
+        }
+    }
+
+    return numSynths > 0 ? progress / float(numSynths) : 1.f;
+}
+
 int Instrument::getNumNodes() const noexcept
 {
     return this->processorGraph->getNumNodes();
@@ -933,6 +951,7 @@ void Instrument::AudioCallback::audioDeviceIOCallback(const float** const inputC
 
     this->incomingMidi.clear();
     this->messageCollector.removeNextBlockOfMessages(this->incomingMidi, numSamples);
+    this->dispatchScheduledMessages(numSamples);
     int totalNumChans = 0;
 
     if (numInputChannels > numOutputChannels)
@@ -1057,3 +1076,114 @@ void Instrument::AudioCallback::handleIncomingMidiMessage(MidiInput *, const Mid
 {
     this->messageCollector.addMessageToQueue(message);
 }
+
+void Instrument::AudioCallback::startPlaybackSession(int sessionId) noexcept
+{
+    this->currentSessionId = sessionId;
+}
+
+void Instrument::AudioCallback::stopPlaybackSession(int sessionId) noexcept
+{
+    // only if no newer session has started in the meantime
+    this->currentSessionId.compareAndSetBool(0, sessionId);
+}
+
+void Instrument::AudioCallback::scheduleMessage(const MidiMessage &message,
+    double timeMs, int sessionId)
+{
+    const SpinLock::ScopedLockType lock(this->scheduledQueueWriteLock);
+
+    int start1, size1, start2, size2;
+    this->scheduledQueue.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0)
+    {
+        // the audio device is stopped or stuck, or the schedule
+        // is just that dense, so send it now rather than losing it
+        MidiMessage m(message);
+        m.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+        this->messageCollector.addMessageToQueue(m);
+        return;
+    }
+
+    auto &scheduled = this->scheduledMessages[start1];
+    scheduled.message = message;
+    scheduled.timeMs = timeMs;
+    scheduled.sessionId = sessionId;
+    this->scheduledQueue.finishedWrite(1);
+}
+
+void Instrument::AudioCallback::dispatchScheduledMessages(int numSamples)
+{
+    if (this->sampleRate <= 0.0 || this->scheduledQueue.getNumReady() == 0)
+    {
+        return;
+    }
+
+    // the block start time is predicted from the previous block,
+    // so that the callback's own jitter doesn't affect the positions,
+    // and is gently pulled towards the clock, resyncing after the dropouts
+    const auto nowMs = Time::getMillisecondCounterHiRes();
+    const auto blockDurationMs = double(numSamples) * 1000.0 / this->sampleRate;
+    const auto driftMs = nowMs - this->blockStartTimeMs;
+    if (std::abs(driftMs) > blockDurationMs)
+    {
+        this->blockStartTimeMs = nowMs;
+    }
+    else
+    {
+        this->blockStartTimeMs += driftMs * 0.05;
+    }
+
+    const auto blockStartMs = this->blockStartTimeMs;
+    const auto blockEndMs = blockStartMs + blockDurationMs;
+    this->blockStartTimeMs = blockEndMs;
+
+    const auto sessionId = this->currentSessionId.get();
+
+    int start1, size1, start2, size2;
+    this->scheduledQueue.prepareToRead(this->scheduledQueue.getNumReady(),
+        start1, size1, start2, size2);
+
+    int numRead = 0;
+    const auto dispatch = [&](int start, int size)
+    {
+        for (int i = start; i < start + size; ++i)
+        {
+            const auto &scheduled = this->scheduledMessages[i];
+
+            // the player forgets about the held notes as soon as it schedules
+            // their note-offs, so the stopped sessions' note-offs are played
+            // right away instead of being dropped, or the notes would hang
+            if (scheduled.sessionId != sessionId)
+            {
+                if (scheduled.message.isNoteOff() || scheduled.message.isSustainPedalOff())
+                {
+                    this->incomingMidi.addEvent(scheduled.message, 0);
+                }
+            }
+            else
+            {
+                if (scheduled.timeMs >= blockEndMs)
+                {
+                    return false;
+                }
+
+                const auto position = jlimit(0, numSamples - 1,
+                    int((scheduled.timeMs - blockStartMs) * this->sampleRate * 0.001));
+
+                this->incomingMidi.addEvent(scheduled.message, position);
+            }
+
+            numRead++;
+        }
+
+        return true;
+    };
+
+    if (dispatch(start1, size1))
+    {
+        dispatch(start2, size2);
+    }
+
+    this->scheduledQueue.finishedRead(numRead);
+}
@@ -39,6 +39,10 @@ public:
     bool isMetronomeInstrument() const noexcept;
     bool isMidiOutputInstrument() const noexcept;
 
+    // The built-in SoundFont synths load their samples in the background,
+    // this returns their average progress, or 1 if none of them is loading
+    float getLoadingProgress() const;
+
     using InitializationCallback = Function<void(Instrument *)>;
 
     using IOProcessor = AudioProcessorGraph::AudioGraphIOProcessor;
@@ -65,6 +69,15 @@ public:
         void audioDeviceStopped() override;
         void handleIncomingMidiMessage(MidiInput *, const MidiMessage &) override;
 
+        // The player thread schedules the messages a bit ahead of time,
+        // with the times in Time::getMillisecondCounterHiRes terms,
+        // and they are dispatched at their sample positions within the block;
+        // the messages of the stopped playback sessions are dropped,
+        // except for the note-offs, which are sent immediately
+        void startPlaybackSession(int sessionId) noexcept;
+        void stopPlaybackSession(int sessionId) noexcept;
+        void scheduleMessage(const MidiMessage &message, double timeMs, int sessionId);
+
     private:
 
         AudioProcessor *processor = nullptr;
@@ -81,6 +94,28 @@ public:
         MidiBuffer incomingMidi;
         MidiMessageCollector messageCollector;
 
+        void dispatchScheduledMessages(int numSamples);
+
+        struct ScheduledMessage final
+        {
+            MidiMessage message;
+            double timeMs = 0.0;
+            int sessionId = 0;
+        };
+
+        // a single-reader queue, only the writers are serialized,
+        // since the old player might still be exiting when the new one starts
+        static constexpr auto scheduledQueueSize = 4096;
+        AbstractFifo scheduledQueue { scheduledQueueSize };
+        std::vector<ScheduledMessage> scheduledMessages =
+            std::vector<ScheduledMessage>(scheduledQueueSize);
+        SpinLock scheduledQueueWriteLock;
+
+        Atomic<int> currentSessionId = 0;
+
+        // the audio thread's estimate of when the current block starts
+        double blockStartTimeMs = 0.0;
+
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioCallback)
     };
 
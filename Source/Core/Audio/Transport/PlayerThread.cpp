@@ -19,6 +19,10 @@
 
 #include "PlayerThread.h"
 
+// all players share the instruments' schedules,
+// so each playback gets its own session id
+static Atomic<int> lastPlaybackSessionId = 0;
+
 PlayerThread::PlayerThread(Transport &transport) :
     Thread("PlayerThread"),
     transport(transport) {}
@@ -36,6 +40,13 @@ void PlayerThread::startPlayback(Transport::PlaybackContext::Ptr context)
 {
     this->context = context;
     this->sequences = this->transport.getPlaybackCache();
+
+    {
+        const SpinLock::ScopedLockType lock(this->pendingSequencesLock);
+        this->pendingSequences.clear();
+        this->hasPendingSequences = false;
+    }
+
     this->speedMultiplier = 1.f;
     this->speedMultiplierChanged = false;
     this->startThread(10);
@@ -47,14 +58,36 @@ void PlayerThread::setSpeedMultiplier(float multiplier)
     {
         this->speedMultiplier = multiplier;
         this->speedMultiplierChanged = true;
+        this->notify();
+    }
+}
+
+void PlayerThread::updatePlaybackCache(TransportPlaybackCache &&newSequences)
+{
+    {
+        const SpinLock::ScopedLockType lock(this->pendingSequencesLock);
+        // move assignment swaps, so the older pending cache,
+        // if any, is released outside of the lock
+        this->pendingSequences = move(newSequences);
+        this->hasPendingSequences = true;
     }
+
+    newSequences.clear();
+    this->notify();
 }
 
 void PlayerThread::run()
 {
+    const auto sessionId = ++lastPlaybackSessionId;
+
     Array<Instrument *> uniqueInstruments;
     uniqueInstruments.addArray(this->sequences.getUniqueInstruments());
 
+    for (auto &instrument : uniqueInstruments)
+    {
+        instrument->getProcessorPlayer().startPlaybackSession(sessionId);
+    }
+
     auto broadcastSeekAndTempo = [this](float beat)
     {
         this->transport.broadcastSeek(beat);
@@ -76,6 +109,26 @@ void PlayerThread::run()
     Atomic<float> previousEventBeat = this->context->startBeat;
     broadcastSeekAndTempo(previousEventBeat.get());
 
+    // The events' times are calculated from the anchor point instead of
+    // accumulating the deltas between the events, so the errors don't add up;
+    // the anchor moves at the tempo changes, the speed changes and the rewinds
+    double anchorBeat = this->context->startBeat;
+    double anchorTimeMs = Time::getMillisecondCounterHiRes();
+    double msPerBeat = this->currentTempo.get() / this->speedMultiplier.get();
+
+    auto getTimeAtBeat = [&](double beat)
+    {
+        return anchorTimeMs + (beat - anchorBeat) * msPerBeat;
+    };
+
+    auto getBeatAtTime = [&](double timeMs)
+    {
+        return anchorBeat + (timeMs - anchorTimeMs) / msPerBeat;
+    };
+
+    // the time of the last scheduled event, which might be in the future
+    double lastScheduledTimeMs = anchorTimeMs;
+
     // This hack is here to keep track of still playing events
     // to be able to send noteOff's when playback interrupts.
     struct HoldingNote final
@@ -83,6 +136,7 @@ void PlayerThread::run()
         int key;
         int channel;
         MidiMessageCollector *listener;
+        Instrument *instrument;
     };
     // (some plugins just don't understand allNotesOff message)
     Array<HoldingNote> holdingNotes;
@@ -120,8 +174,14 @@ void PlayerThread::run()
         }
     };
 
-    auto sendHoldingNotesOffAndMidiStop = [&holdingNotes, &uniqueInstruments]()
+    auto sendHoldingNotesOffAndMidiStop = [&holdingNotes, &uniqueInstruments, sessionId]()
     {
+        // drop whatever is scheduled but not yet played
+        for (auto &instrument : uniqueInstruments)
+        {
+            instrument->getProcessorPlayer().stopPlaybackSession(sessionId);
+        }
+
         for (const auto &holding : holdingNotes)
         {
             MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
@@ -142,13 +202,152 @@ void PlayerThread::run()
         Thread::sleep(50);
     };
     
-    auto sendTempoChangeToEverybody =
-        [&uniqueInstruments](const MidiMessage &tempoEvent)
+    auto scheduleTempoChangeForEverybody =
+        [&uniqueInstruments, sessionId](const MidiMessage &tempoEvent, double timeMs)
     {
         for (auto &instrument : uniqueInstruments)
         {
-            instrument->getProcessorPlayer().
-                getMidiMessageCollector().addMessageToQueue(tempoEvent);
+            instrument->getProcessorPlayer().scheduleMessage(tempoEvent, timeMs, sessionId);
+        }
+    };
+
+    // Switches to the edited cache and seeks it right after the given beat,
+    // so that the events which were already scheduled are not repeated;
+    // the held notes, which are deleted or made shorter in the new cache,
+    // will never receive their note-offs from it, so they are released here,
+    // but not before the note-ons which might still be waiting in the schedule
+    auto swapPendingSequences = [&](float beat)
+    {
+        TransportPlaybackCache previousSequences;
+
+        {
+            const SpinLock::ScopedLockType lock(this->pendingSequencesLock);
+            previousSequences = move(this->sequences);
+            this->sequences = move(this->pendingSequences);
+            this->hasPendingSequences = false;
+        }
+
+        this->sequences.seekToTime(std::nextafter(double(beat), DBL_MAX));
+
+        // the instruments which are no longer used by the new cache, e.g. when
+        // a track's instrument was changed, are stopped right away, like at the
+        // playback end: whatever is scheduled for them is dropped, so their
+        // held notes are released immediately, and they receive the midi stop
+        Array<Instrument *> droppedInstruments;
+        const auto newInstruments = this->sequences.getUniqueInstruments();
+        for (auto *instrument : uniqueInstruments)
+        {
+            if (!newInstruments.contains(instrument))
+            {
+                droppedInstruments.add(instrument);
+                instrument->getProcessorPlayer().stopPlaybackSession(sessionId);
+            }
+        }
+
+        const auto noteOffTimeMs = jmax(lastScheduledTimeMs, Time::getMillisecondCounterHiRes());
+
+        for (int i = holdingNotes.size() - 1; i >= 0; --i)
+        {
+            const auto &holding = holdingNotes.getReference(i);
+            if (droppedInstruments.contains(holding.instrument))
+            {
+                MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
+                noteOff.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+                holding.listener->addMessageToQueue(noteOff);
+                holdingNotes.remove(i);
+            }
+            else if (!this->sequences.hasPendingNoteOff(holding.listener, holding.channel, holding.key))
+            {
+                const MidiMessage noteOff(MidiMessage::noteOff(holding.channel, holding.key, 0.f));
+                holding.instrument->getProcessorPlayer().scheduleMessage(noteOff, noteOffTimeMs, sessionId);
+                holdingNotes.remove(i);
+            }
+        }
+
+        if (!droppedInstruments.isEmpty())
+        {
+            MidiMessage stopPlayback(MidiMessage::midiStop());
+            stopPlayback.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+            for (auto *instrument : droppedInstruments)
+            {
+                instrument->getProcessorPlayer()
+                    .getMidiMessageCollector().addMessageToQueue(stopPlayback);
+            }
+        }
+
+        uniqueInstruments.clearQuick();
+        uniqueInstruments.addArray(newInstruments);
+
+        for (auto &instrument : uniqueInstruments)
+        {
+            instrument->getProcessorPlayer().startPlaybackSession(sessionId);
+        }
+    };
+
+    // Re-anchors at the current time, if the speed has changed
+    auto updateSpeedMultiplier = [&]()
+    {
+        if (!this->speedMultiplierChanged.get())
+        {
+            return;
+        }
+
+        const auto nowMs = Time::getMillisecondCounterHiRes();
+        anchorBeat = getBeatAtTime(nowMs);
+        anchorTimeMs = nowMs;
+
+        // the events up to the previous one might be already scheduled,
+        // and the seek position is not supposed to go back
+        broadcastSeekAndTempo(jmax(previousEventBeat.get(), float(anchorBeat)));
+        msPerBeat = this->currentTempo.get() / this->speedMultiplier.get();
+    };
+
+    // The loop is seamless, i.e. the rewind beat is scheduled at the end beat's time
+    auto rewind = [&]()
+    {
+        anchorTimeMs = getTimeAtBeat(this->context->endBeat);
+        anchorBeat = this->context->rewindBeat;
+
+        this->sequences.seekToTime(this->context->rewindBeat);
+        previousEventBeat = this->context->rewindBeat;
+        broadcastSeekAndTempo(previousEventBeat.get());
+    };
+
+    enum class WaitResult
+    {
+        Reached,
+        ShouldExit,
+        SequencesSwapped
+    };
+
+    // Sleeps until the given beat's time minus the lookahead, not busy-waiting,
+    // but waking up on the speed changes and the cache updates, see notify() calls
+    auto waitForBeat = [&](double beat, double aheadMs)
+    {
+        while (true)
+        {
+            if (this->threadShouldExit())
+            {
+                return WaitResult::ShouldExit;
+            }
+
+            updateSpeedMultiplier();
+
+            if (this->hasPendingSequences.get())
+            {
+                const auto currentBeat = getBeatAtTime(Time::getMillisecondCounterHiRes());
+                previousEventBeat = jmax(previousEventBeat.get(), float(currentBeat));
+                swapPendingSequences(previousEventBeat.get());
+                return WaitResult::SequencesSwapped;
+            }
+
+            const auto waitMs = getTimeAtBeat(beat) - aheadMs - Time::getMillisecondCounterHiRes();
+            if (waitMs < 1.0)
+            {
+                return WaitResult::Reached;
+            }
+
+            this->wait(jmin(int(waitMs), PlayerThread::minStopCheckTimeMs));
         }
     };
 
@@ -157,53 +356,40 @@ void PlayerThread::run()
     sendMidiStart();
     sendControllerStates();
 
-    double nextEventTimeDelta = 0.0;
-    double deltaTimePassed = 0.0;
-
     while (1)
     {
         CachedMidiMessage wrapper;
+        auto hasNextMessage = this->sequences.getNextMessage(wrapper);
 
-        // Handle playback from the last event to the end of the track:
-        if (!this->sequences.getNextMessage(wrapper))
+        // Only switch the caches between the chords, not in the middle of one
+        if (this->hasPendingSequences.get() &&
+            (!hasNextMessage || wrapper.message.getTimeStamp() > previousEventBeat.get()))
         {
-            const auto previousEventTime = Time::getMillisecondCounter();
-            const auto beatDelta = this->context->endBeat - previousEventBeat.get();
+            swapPendingSequences(previousEventBeat.get());
+            hasNextMessage = this->sequences.getNextMessage(wrapper);
+        }
 
-            nextEventTimeDelta = beatDelta *
-                (this->currentTempo.get() / this->speedMultiplier.get());
+        // Handle playback from the last event to the end of the track:
+        if (!hasNextMessage)
+        {
+            // when not looping, all scheduled events must be played before stopping
+            const auto waitResult = waitForBeat(this->context->endBeat,
+                isLooped ? PlayerThread::scheduleAheadMs : 0.0);
 
-            deltaTimePassed = 0.0;
-            while (deltaTimePassed < (nextEventTimeDelta - PlayerThread::minStopCheckTimeMs))
+            if (waitResult == WaitResult::ShouldExit)
             {
-                const auto a = Time::getMillisecondCounter();
-                Thread::sleep(PlayerThread::minStopCheckTimeMs);
-                const auto shouldExit = this->threadShouldExit();
-                const auto b = Time::getMillisecondCounter();
-                deltaTimePassed += double(b - a);
-
-                if (shouldExit)
-                {
-                    sendHoldingNotesOffAndMidiStop();
-                    return; // the transport has already stopped
-                }
-
-                if (this->speedMultiplierChanged.get())
-                {
-                    const auto beatsPassed = beatDelta * float(deltaTimePassed / nextEventTimeDelta);
-                    broadcastSeekAndTempo(previousEventBeat.get() + beatsPassed);
-                    nextEventTimeDelta = deltaTimePassed + ((beatDelta - beatsPassed) *
-                        (this->currentTempo.get() / this->speedMultiplier.get()));
-                }
+                sendHoldingNotesOffAndMidiStop();
+                return; // the transport has already stopped
             }
 
-            Time::waitForMillisecondCounter(previousEventTime + uint32(nextEventTimeDelta));
+            if (waitResult == WaitResult::SequencesSwapped)
+            {
+                continue;
+            }
 
             if (isLooped)
             {
-                this->sequences.seekToTime(this->context->rewindBeat);
-                previousEventBeat = this->context->rewindBeat;
-                broadcastSeekAndTempo(previousEventBeat.get());
+                rewind();
                 continue;
             }
             else
@@ -236,64 +422,37 @@ void PlayerThread::run()
             float(shouldRewind ? this->context->endBeat : messageBeat);
 
         jassert(previousEventBeat.get() <= nextEventBeat);
-        const auto beatDelta = nextEventBeat - previousEventBeat.get();
 
-        nextEventTimeDelta = beatDelta *
-            (this->currentTempo.get() / this->speedMultiplier.get());
+        const auto waitResult = waitForBeat(nextEventBeat, PlayerThread::scheduleAheadMs);
 
-        // Zero-delay check (we're playing a chord or so)
-        if (uint32(nextEventTimeDelta) != 0)
+        if (waitResult == WaitResult::ShouldExit)
         {
-            const auto previousEventTime = Time::getMillisecondCounter();
-
-            deltaTimePassed = 0.0;
-            while (deltaTimePassed < (nextEventTimeDelta - PlayerThread::minStopCheckTimeMs))
-            {
-                const auto a = Time::getMillisecondCounter();
-                Thread::sleep(PlayerThread::minStopCheckTimeMs);
-                const auto shouldExit = this->threadShouldExit();
-                const auto b = Time::getMillisecondCounter();
-                deltaTimePassed += double(b - a);
-
-                if (shouldExit)
-                {
-                    sendHoldingNotesOffAndMidiStop();
-                    return;
-                }
-
-                if (this->speedMultiplierChanged.get())
-                {
-                    const auto beatsPassed = beatDelta * float(deltaTimePassed / nextEventTimeDelta);
-                    broadcastSeekAndTempo(previousEventBeat.get() + beatsPassed);
-                    nextEventTimeDelta = deltaTimePassed + ((beatDelta - beatsPassed) *
-                        (this->currentTempo.get() / this->speedMultiplier.get()));
-                }
-            }
-
-            Time::waitForMillisecondCounter(previousEventTime + uint32(nextEventTimeDelta));
+            sendHoldingNotesOffAndMidiStop();
+            return;
+        }
 
-            if (this->threadShouldExit())
-            {
-                sendHoldingNotesOffAndMidiStop();
-                return;
-            }
+        if (waitResult == WaitResult::SequencesSwapped)
+        {
+            continue;
+        }
 
+        if (nextEventBeat > previousEventBeat.get())
+        {
             broadcastSeekAndTempo(nextEventBeat);
         }
-        
+
         if (shouldRewind)
         {
-            this->sequences.seekToTime(this->context->rewindBeat);
-            previousEventBeat = this->context->rewindBeat;
-            broadcastSeekAndTempo(previousEventBeat.get());
+            rewind();
         }
         else
         {
             previousEventBeat = nextEventBeat;
-     
+
             const int key = wrapper.message.getNoteNumber();
             const int channel = wrapper.message.getChannel();
-            wrapper.message.setTimeStamp(Time::getMillisecondCounterHiRes() * 0.001);
+            const auto eventTimeMs = getTimeAtBeat(messageBeat);
+            lastScheduledTimeMs = eventTimeMs;
             
             // Master tempo event is sent to everybody
             if (wrapper.message.isTempoMetaEvent())
@@ -301,12 +460,17 @@ void PlayerThread::run()
                 this->currentTempo = wrapper.message.getTempoSecondsPerQuarterNote() * 1000.f;
                 this->transport.broadcastCurrentTempoChanged(this->currentTempo.get() / this->speedMultiplier.get());
 
+                anchorBeat = messageBeat;
+                anchorTimeMs = eventTimeMs;
+                msPerBeat = this->currentTempo.get() / this->speedMultiplier.get();
+
                 // Sends this to everybody (need to do that for drum-machines) - TODO test
-                sendTempoChangeToEverybody(wrapper.message);
+                scheduleTempoChangeForEverybody(wrapper.message, eventTimeMs);
             }
             else
             {
-                wrapper.listener->addMessageToQueue(wrapper.message);
+                wrapper.instrument->getProcessorPlayer()
+                    .scheduleMessage(wrapper.message, eventTimeMs, sessionId);
             }
             
             // todo automating individual plugin node parameters
@@ -314,7 +478,7 @@ void PlayerThread::run()
 
             if (wrapper.message.isNoteOn())
             {
-                holdingNotes.add({ key, channel, wrapper.listener });
+                holdingNotes.add({ key, channel, wrapper.listener, wrapper.instrument });
             }
             
             if (wrapper.message.isNoteOff())
@@ -30,6 +30,11 @@ public:
 
     void setSpeedMultiplier(float multiplier);
 
+    // The project was edited during the playback: the player switches
+    // to the new cache at the next event, or while waiting for it,
+    // and keeps the current position and the held notes
+    void updatePlaybackCache(TransportPlaybackCache &&newSequences);
+
 private:
 
     void run() override;
@@ -37,6 +42,10 @@ private:
     Transport &transport;
     TransportPlaybackCache sequences;
 
+    SpinLock pendingSequencesLock;
+    TransportPlaybackCache pendingSequences;
+    Atomic<bool> hasPendingSequences = false;
+
     Transport::PlaybackContext::Ptr context;
 
     Atomic<float> speedMultiplier = 1.f;
@@ -47,5 +56,10 @@ private:
     // check if the thread needs to stop at least every x ms:
     static constexpr auto minStopCheckTimeMs = 200;
 
+    // the events are sent to the instruments this much before their time,
+    // and then played sample-accurately, see Instrument::AudioCallback;
+    // this only needs to be longer than the audio block plus the thread's wake-up jitter
+    static constexpr auto scheduleAheadMs = 50.0;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PlayerThread)
 };
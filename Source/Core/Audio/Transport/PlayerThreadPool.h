@@ -40,6 +40,7 @@ public:
         for (int i = 0; i < this->players.size(); ++i)
         {
             this->players.getUnchecked(i)->signalThreadShouldExit();
+            this->players.getUnchecked(i)->notify();
         }
     }
 
@@ -48,6 +49,7 @@ public:
         if (this->currentPlayer->isThreadRunning())
         {
             this->currentPlayer->signalThreadShouldExit();
+            this->currentPlayer->notify();
             this->currentPlayer = this->findNextFreePlayer();
         }
 
@@ -66,8 +68,17 @@ public:
         if (this->currentPlayer->isThreadRunning())
         {
             // Just signal player to stop:
-            // it might be waiting for the next midi event, so it won't stop immediately
+            // it might be waiting for the next midi event, so wake it up
             this->currentPlayer->signalThreadShouldExit();
+            this->currentPlayer->notify();
+        }
+    }
+
+    void updatePlaybackCache(TransportPlaybackCache &&cache)
+    {
+        if (this->isPlaying())
+        {
+            this->currentPlayer->updatePlaybackCache(move(cache));
         }
     }
 
@@ -0,0 +1,114 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "RawPcmAudioFormat.h"
+
+class RawPcmAudioFormatWriter final : public AudioFormatWriter
+{
+public:
+
+    RawPcmAudioFormatWriter(OutputStream *out, double sampleRate, unsigned int numChannels) :
+        AudioFormatWriter(out, "Raw PCM", sampleRate, numChannels, 32)
+    {
+        // so that writeFromAudioSampleBuffer passes the floats as is
+        this->usesFloatingPointData = true;
+    }
+
+    bool write(const int **data, int numSamples) override
+    {
+        jassert(numSamples >= 0);
+        const auto numValues = size_t(numSamples) * this->numChannels;
+        if (this->interleaved.size() < numValues)
+        {
+            this->interleaved.resize(numValues);
+        }
+
+        for (unsigned int channel = 0; channel < this->numChannels; ++channel)
+        {
+            const auto *source = reinterpret_cast<const float *>(data[channel]);
+            auto *destination = this->interleaved.data() + channel;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                uint32 value = 0;
+                if (source != nullptr)
+                {
+                    memcpy(&value, source + i, sizeof(float));
+                }
+
+                *destination = ByteOrder::swapIfBigEndian(value);
+                destination += this->numChannels;
+            }
+        }
+
+        return this->output->write(this->interleaved.data(), numValues * sizeof(uint32));
+    }
+
+private:
+
+    std::vector<uint32> interleaved;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RawPcmAudioFormatWriter)
+};
+
+RawPcmAudioFormat::RawPcmAudioFormat() :
+    AudioFormat("Raw PCM", ".raw") {}
+
+Array<int> RawPcmAudioFormat::getPossibleSampleRates()
+{
+    return { 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000 };
+}
+
+Array<int> RawPcmAudioFormat::getPossibleBitDepths()
+{
+    return { 32 };
+}
+
+bool RawPcmAudioFormat::canDoStereo()
+{
+    return true;
+}
+
+bool RawPcmAudioFormat::canDoMono()
+{
+    return true;
+}
+
+AudioFormatReader *RawPcmAudioFormat::createReaderFor(InputStream *sourceStream,
+    bool deleteStreamIfOpeningFails)
+{
+    // write-only, so opening always fails
+    if (deleteStreamIfOpeningFails)
+    {
+        delete sourceStream;
+    }
+
+    return nullptr;
+}
+
+AudioFormatWriter *RawPcmAudioFormat::createWriterFor(OutputStream *streamToWriteTo,
+    double sampleRateToUse, unsigned int numberOfChannels,
+    int bitsPerSample, const StringPairArray &, int)
+{
+    if (streamToWriteTo == nullptr || bitsPerSample != 32)
+    {
+        return nullptr;
+    }
+
+    return new RawPcmAudioFormatWriter(streamToWriteTo, sampleRateToUse, numberOfChannels);
+}
@@ -0,0 +1,47 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Headerless interleaved 32-bit float samples in little-endian byte order,
+// for feeding the render output into other tools as is; write-only,
+// since without a header there's nothing to detect the stream's layout from
+
+class RawPcmAudioFormat final : public AudioFormat
+{
+public:
+
+    RawPcmAudioFormat();
+
+    Array<int> getPossibleSampleRates() override;
+    Array<int> getPossibleBitDepths() override;
+    bool canDoStereo() override;
+    bool canDoMono() override;
+
+    AudioFormatReader *createReaderFor(InputStream *sourceStream,
+        bool deleteStreamIfOpeningFails) override;
+
+    using AudioFormat::createWriterFor;
+    AudioFormatWriter *createWriterFor(OutputStream *streamToWriteTo,
+        double sampleRateToUse, unsigned int numberOfChannels,
+        int bitsPerSample, const StringPairArray &metadataValues,
+        int qualityOptionIndex) override;
+
+private:
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RawPcmAudioFormat)
+};
@@ -17,10 +17,15 @@
 
 #pragma once
 
+#include "RawPcmAudioFormat.h"
+
 enum class RenderFormat : int8
 {
     FLAC,
-    WAV
+    WAV,
+    AIFF,
+    OGG,
+    RAW
 };
 
 inline String getExtensionForRenderFormat(RenderFormat format) noexcept
@@ -29,7 +34,51 @@ inline String getExtensionForRenderFormat(RenderFormat format) noexcept
     {
     case RenderFormat::FLAC: return "flac";
     case RenderFormat::WAV:  return "wav";
+    case RenderFormat::AIFF: return "aiff";
+    case RenderFormat::OGG:  return "ogg";
+    case RenderFormat::RAW:  return "raw";
+    }
+
+    return {};
+}
+
+// All of these formats' writers encode the data block by block,
+// so the renderer streams into them without keeping the whole song
+inline UniquePointer<AudioFormat> createAudioFormatFor(RenderFormat format)
+{
+    switch (format)
+    {
+    case RenderFormat::FLAC: return make<FlacAudioFormat>();
+    case RenderFormat::WAV:  return make<WavAudioFormat>();
+    case RenderFormat::AIFF: return make<AiffAudioFormat>();
+    case RenderFormat::OGG:  return make<OggVorbisAudioFormat>();
+    case RenderFormat::RAW:  return make<RawPcmAudioFormat>();
     }
 
     return {};
 }
+
+// The defaults are the same as they always were
+struct RenderOptions final
+{
+    int blockSize = 512;
+
+    // 16 or 24 bits integer, or 32 bits float, which is written as is,
+    // without any requantisation; if the format doesn't support the bit depth,
+    // the closest lower one is used, e.g. FLAC only supports up to 24 bits,
+    // and the lossy and the raw formats ignore it
+    int bitDepth = 16;
+
+    // only for the instruments whose processor graphs support it,
+    // the others are still processed in single precision
+    bool doublePrecision = false;
+
+    // also write each instrument's output into a separate file next to the
+    // target, named after the instrument, in the same pass as the mixdown;
+    // the tracks sharing an instrument are mixed within its graph, so they
+    // share a stem; only supported for the local files
+    bool renderStems = false;
+
+    static constexpr auto minBlockSize = 32;
+    static constexpr auto maxBlockSize = 8192;
+};
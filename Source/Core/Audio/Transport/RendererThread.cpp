@@ -20,13 +20,126 @@
 #include "Workspace.h"
 #include "AudioCore.h"
 
+#if JUCE_LINUX || JUCE_MAC
+#   include <cerrno>
+#   include <csignal>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+// the writers' fifo size, a few seconds at the usual sample rates
+static constexpr auto kWriterBufferSamples = 1 << 17;
+
+// how long to wait for the writer thread to catch up before giving up
+static constexpr auto kMaxWriterWaitMs = 10000;
+
+#if JUCE_LINUX || JUCE_MAC
+
+// FileOutputStream can't write into named pipes, since it seeks to the end
+// of the file on opening, so the raw output uses this one instead:
+// no seeking at all, just writing the data as it goes
+class PipeOutputStream final : public OutputStream
+{
+public:
+
+    // Returns nullptr if nobody reads from the pipe yet
+    static UniquePointer<OutputStream> open(const File &file)
+    {
+        const auto handle = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY | O_NONBLOCK);
+        if (handle < 0)
+        {
+            return {};
+        }
+
+        // non-blocking was only needed to not hang if there's no reader
+        fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) & ~O_NONBLOCK);
+
+        // when the reader goes away mid-render, writing into the pipe
+        // raises SIGPIPE, which terminates the app by default; with it
+        // ignored, the write just fails with EPIPE, and so does the render
+#if JUCE_MAC
+        fcntl(handle, F_SETNOSIGPIPE, 1);
+#else
+        static const bool sigPipeIgnored = (std::signal(SIGPIPE, SIG_IGN) != SIG_ERR);
+        ignoreUnused(sigPipeIgnored);
+#endif
+
+        return UniquePointer<OutputStream>(new PipeOutputStream(handle));
+    }
+
+    ~PipeOutputStream() override
+    {
+        ::close(this->handle);
+    }
+
+    void flush() override {}
+
+    bool setPosition(int64) override { return false; }
+
+    int64 getPosition() override { return this->position; }
+
+    bool write(const void *data, size_t numBytes) override
+    {
+        const auto *bytes = static_cast<const char *>(data);
+        while (numBytes > 0)
+        {
+            const auto numWritten = ::write(this->handle, bytes, numBytes);
+            if (numWritten < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (numWritten <= 0)
+            {
+                return false; // including EPIPE, when the reader is gone
+            }
+
+            bytes += numWritten;
+            numBytes -= size_t(numWritten);
+            this->position += numWritten;
+        }
+
+        return true;
+    }
+
+private:
+
+    explicit PipeOutputStream(int handleIn) : handle(handleIn) {}
+
+    const int handle;
+    int64 position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PipeOutputStream)
+};
+
+static bool isNamedPipe(const File &file)
+{
+    struct stat info;
+    return stat(file.getFullPathName().toRawUTF8(), &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
+static UniquePointer<OutputStream> openNamedPipe(const File &file)
+{
+    return PipeOutputStream::open(file);
+}
+
+#else
+
+static bool isNamedPipe(const File &) { return false; }
+static UniquePointer<OutputStream> openNamedPipe(const File &) { return {}; }
+
+#endif
+
 RendererThread::RendererThread(Transport &transport) :
     Thread("RendererThread"),
-    transport(transport) {}
+    transport(transport),
+    writerThread("RenderWriter") {}
 
 RendererThread::~RendererThread()
 {
     this->stop();
+    this->writerThread.stopThread(1000);
 }
 
 float RendererThread::getPercentsComplete() const noexcept
@@ -34,14 +147,27 @@ float RendererThread::getPercentsComplete() const noexcept
     return this->percentsDone.get();
 }
 
+float RendererThread::getInstrumentsLoadingProgress() const noexcept
+{
+    return this->instrumentsLoadingProgress.get();
+}
+
+bool RendererThread::hasRenderFailed() const noexcept
+{
+    return this->renderFailed.get();
+}
+
 bool RendererThread::startRendering(const URL &target, RenderFormat format,
     Transport::PlaybackContext::Ptr playbackContext,
-    int waveformThumbnailResolution)
+    int waveformThumbnailResolution, const RenderOptions &renderOptions)
 {
     this->stop();
 
     this->format = format;
     this->context = playbackContext;
+    this->options = renderOptions;
+    this->options.blockSize = jlimit(RenderOptions::minBlockSize,
+        RenderOptions::maxBlockSize, renderOptions.blockSize);
 
     this->waveformThumbnail.clearQuick();
     this->waveformThumbnail.resize(waveformThumbnailResolution);
@@ -50,11 +176,17 @@ bool RendererThread::startRendering(const URL &target, RenderFormat format,
     // since on iOS it contains a security bookmark:
     this->renderTarget = target;
 
+    // a named pipe is not deleted and re-created as a file, but written into
+    // as is; that is meant for the raw format, since the other writers
+    // would try to seek back to update their headers when finished
+    const auto isPipeTarget = this->renderTarget.isLocalFile() &&
+        isNamedPipe(this->renderTarget.getLocalFile());
+
 #if PLATFORM_DESKTOP
     // on some mobile systems we won't be able to write to the file after deleting it
     try
     {
-        if (this->renderTarget.isLocalFile() &&
+        if (this->renderTarget.isLocalFile() && !isPipeTarget &&
             this->renderTarget.getLocalFile().exists())
         {
             if (!this->renderTarget.getLocalFile().deleteFile()) {
@@ -69,27 +201,18 @@ bool RendererThread::startRendering(const URL &target, RenderFormat format,
     }
 #endif
 
-    if (auto outStream = this->renderTarget.createOutputStream())
+    auto outStream = isPipeTarget ?
+        openNamedPipe(this->renderTarget.getLocalFile()) :
+        this->renderTarget.createOutputStream();
+
+    if (outStream != nullptr)
     {
         this->percentsDone = 0.f;
-        
-        // 16 bits per sample should be enough for anybody :)
-        // ..wanna fight about it? https://people.xiph.org/~xiphmont/demo/neil-young.html
-        constexpr int bitDepth = 16;
+        this->renderFailed = false;
 
-        if (this->format == RenderFormat::WAV)
-        {
-            WavAudioFormat wavFormat;
-            const ScopedLock sl(this->writerLock);
-            this->writer.reset(wavFormat.createWriterFor(outStream.release(),
-                this->context->sampleRate, this->context->numOutputChannels, bitDepth, {}, 0));
-        }
-        else if (this->format == RenderFormat::FLAC)
         {
-            FlacAudioFormat flacFormat;
             const ScopedLock sl(this->writerLock);
-            this->writer.reset(flacFormat.createWriterFor(outStream.release(),
-                this->context->sampleRate, this->context->numOutputChannels, bitDepth, {}, 0));
+            this->writer = this->createWriterFor(move(outStream));
         }
 
         if (writer != nullptr)
@@ -128,6 +251,76 @@ bool RendererThread::isRendering() const
     return this->isThreadRunning();
 }
 
+UniquePointer<RendererThread::Writer> RendererThread::createWriterFor(UniquePointer<OutputStream> stream)
+{
+    // 16 bits per sample should be enough for anybody :)
+    // ..wanna fight about it? https://people.xiph.org/~xiphmont/demo/neil-young.html
+    // (but the stems for further mixing are better kept in floats)
+    auto audioFormat = createAudioFormatFor(this->format);
+    if (audioFormat == nullptr)
+    {
+        return {};
+    }
+
+    const auto possibleBitDepths = audioFormat->getPossibleBitDepths();
+    auto bitDepth = possibleBitDepths.getFirst();
+    for (const auto possibleBitDepth : possibleBitDepths)
+    {
+        if (possibleBitDepth <= this->options.bitDepth)
+        {
+            bitDepth = jmax(bitDepth, possibleBitDepth);
+        }
+    }
+
+    // the fastest compression for FLAC, and something
+    // between the smallest and the best quality for Ogg
+    const auto qualityOptionIndex = this->format == RenderFormat::OGG ?
+        audioFormat->getQualityOptions().size() / 2 : 0;
+
+    auto *formatWriter = audioFormat->createWriterFor(stream.get(),
+        this->context->sampleRate, this->context->numOutputChannels,
+        bitDepth, {}, qualityOptionIndex);
+
+    if (formatWriter == nullptr)
+    {
+        return {};
+    }
+
+    stream.release(); // now owned by the writer
+
+    if (!this->writerThread.isThreadRunning())
+    {
+        this->writerThread.startThread(8);
+    }
+
+    return make<Writer>(formatWriter, this->writerThread, kWriterBufferSamples);
+}
+
+// The threaded writer never blocks: when its fifo is full, i.e. the encoder
+// can't keep up with the rendering, it refuses the data, so the rendering waits;
+// the stems are written from the worker threads, so it's the renderer
+// which is checked for being stopped, not the current thread
+static bool writeBlock(AudioFormatWriter::ThreadedWriter &writer,
+    const AudioBuffer<float> &buffer, int numSamples, const Thread &renderer)
+{
+    for (int i = 0; i < kMaxWriterWaitMs; ++i)
+    {
+        if (writer.write(buffer.getArrayOfReadPointers(), numSamples))
+        {
+            return true;
+        }
+
+        if (renderer.threadShouldExit())
+        {
+            return false;
+        }
+
+        Thread::sleep(1);
+    }
+
+    return false;
+}
+
 //===----------------------------------------------------------------------===//
 // Thread
 //===----------------------------------------------------------------------===//
@@ -136,7 +329,177 @@ struct RenderBuffer final
 {
     Instrument *instrument;
     AudioBuffer<float> sampleBuffer;
+    AudioBuffer<double> doubleSampleBuffer;
+    bool isDoublePrecision = false;
     MidiBuffer midiBuffer;
+
+    UniquePointer<AudioFormatWriter::ThreadedWriter> stemWriter;
+
+    void processBlock()
+    {
+        auto *graph = this->instrument->getProcessorGraph();
+        {
+            const ScopedLock lock(graph->getCallbackLock());
+            if (this->isDoublePrecision)
+            {
+                graph->processBlock(this->doubleSampleBuffer, this->midiBuffer);
+            }
+            else
+            {
+                graph->processBlock(this->sampleBuffer, this->midiBuffer);
+            }
+        }
+
+        this->midiBuffer.clear();
+    }
+
+    // Returns false if the stem could not be written in time,
+    // or if it was dropped before because of that
+    bool writeStem(int numSamples, const Thread &renderer)
+    {
+        if (this->stemWriter == nullptr)
+        {
+            return !this->stemDropped;
+        }
+
+        if (this->isDoublePrecision)
+        {
+            this->sampleBuffer.makeCopyOf(this->doubleSampleBuffer, true);
+        }
+
+        if (!writeBlock(*this->stemWriter, this->sampleBuffer, numSamples, renderer))
+        {
+            // keep rendering the mixdown and the other stems anyway
+            this->stemWriter = nullptr;
+            this->stemDropped = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool stemDropped = false;
+};
+
+// Everything needed to prepare the graph on the message thread
+struct RenderPreparation final
+{
+    AudioProcessorGraph *graph;
+    int numInChannels;
+    int numOutChannels;
+    double sampleRate;
+    int blockSize;
+    AudioProcessor::ProcessingPrecision precision;
+};
+
+// Runs the jobs of each block in parallel on the persistent worker threads,
+// with the calling thread taking part too; the threads are kept alive between
+// the blocks, since starting them for every 512 samples would cost more
+// than most of the processor graphs
+class RenderWorkerPool final
+{
+public:
+
+    explicit RenderWorkerPool(int numWorkers)
+    {
+        for (int i = 0; i < numWorkers; ++i)
+        {
+            this->workers.add(new Worker(*this))->startThread(9);
+        }
+    }
+
+    ~RenderWorkerPool()
+    {
+        for (auto *worker : this->workers)
+        {
+            worker->signalThreadShouldExit();
+            worker->startEvent.signal();
+        }
+
+        for (auto *worker : this->workers)
+        {
+            worker->stopThread(1000);
+        }
+    }
+
+    // Returns when all jobs are done
+    void run(int numJobs, const Function<void(int)> &job)
+    {
+        this->currentJob = &job;
+        this->numJobs = numJobs;
+        this->nextJobIndex = 0;
+        this->numBusyWorkers = this->workers.size();
+
+        for (auto *worker : this->workers)
+        {
+            worker->startEvent.signal();
+        }
+
+        this->runJobs();
+
+        if (!this->workers.isEmpty())
+        {
+            this->finishedEvent.wait();
+        }
+    }
+
+private:
+
+    void runJobs()
+    {
+        for (int i = ++this->nextJobIndex - 1; i < this->numJobs; i = ++this->nextJobIndex - 1)
+        {
+            (*this->currentJob)(i);
+        }
+    }
+
+    class Worker final : public Thread
+    {
+    public:
+
+        explicit Worker(RenderWorkerPool &pool) :
+            Thread("RenderWorker"),
+            pool(pool) {}
+
+        void run() override
+        {
+            while (true)
+            {
+                this->startEvent.wait();
+
+                if (this->threadShouldExit())
+                {
+                    return;
+                }
+
+                this->pool.runJobs();
+
+                if (--this->pool.numBusyWorkers == 0)
+                {
+                    this->pool.finishedEvent.signal();
+                }
+            }
+        }
+
+        WaitableEvent startEvent;
+
+    private:
+
+        RenderWorkerPool &pool;
+
+        JUCE_DECLARE_NON_COPYABLE(Worker)
+    };
+
+    OwnedArray<Worker> workers;
+
+    const Function<void(int)> *currentJob = nullptr;
+    int numJobs = 0;
+
+    Atomic<int> nextJobIndex = 0;
+    Atomic<int> numBusyWorkers = 0;
+    WaitableEvent finishedEvent;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderWorkerPool)
 };
 
 void RendererThread::run()
@@ -152,9 +515,39 @@ void RendererThread::run()
         return;
     }
 
+    // the built-in SoundFont synths load their samples in the background,
+    // e.g. right after the project is opened, and until they are loaded,
+    // they would render silence instead of their notes
+    while (true)
+    {
+        float loadingProgress = 0.f;
+        const auto instruments = sequences.getUniqueInstruments();
+        for (auto *instrument : instruments)
+        {
+            loadingProgress += instrument->getLoadingProgress();
+        }
+
+        loadingProgress = instruments.isEmpty() ? 1.f :
+            loadingProgress / float(instruments.size());
+
+        this->instrumentsLoadingProgress = loadingProgress;
+        if (loadingProgress >= 1.f)
+        {
+            break;
+        }
+
+        if (this->threadShouldExit())
+        {
+            this->instrumentsLoadingProgress = 1.f;
+            return;
+        }
+
+        Thread::sleep(50);
+    }
+
     App::Workspace().getAudioCore().disconnectAllAudioCallbacks();
 
-    constexpr auto bufferSize = 512;
+    const auto bufferSize = this->options.blockSize;
 
     // assuming that number of channels and sample rate is equal for all instruments
     const int numOutChannels = sequences.getNumOutputChannels();
@@ -172,36 +565,103 @@ void RendererThread::run()
         //DBG("Adding instrument: " + String(instrument->getName()));
         auto *subBuffer = new RenderBuffer();
         subBuffer->instrument = instrument;
-        subBuffer->sampleBuffer = AudioBuffer<float>(numOutChannels, bufferSize);
+        subBuffer->isDoublePrecision = this->options.doublePrecision &&
+            instrument->getProcessorGraph()->supportsDoublePrecisionProcessing();
+
+        if (subBuffer->isDoublePrecision)
+        {
+            subBuffer->doubleSampleBuffer = AudioBuffer<double>(numOutChannels, bufferSize);
+        }
+
+        // the float buffer is also needed for writing the double precision stems
+        if (!subBuffer->isDoublePrecision || this->options.renderStems)
+        {
+            subBuffer->sampleBuffer = AudioBuffer<float>(numOutChannels, bufferSize);
+        }
+
         subBuffers.add(subBuffer);
     }
 
+    if (this->options.renderStems && this->renderTarget.isLocalFile())
+    {
+        const auto targetFile = this->renderTarget.getLocalFile();
+
+        StringArray stemNames;
+        for (auto *subBuffer : subBuffers)
+        {
+            const auto instrumentName = File::createLegalFileName(subBuffer->instrument->getName());
+
+            auto stemName = instrumentName;
+            for (int i = 2; stemNames.contains(stemName, true); ++i)
+            {
+                stemName = instrumentName + " " + String(i);
+            }
+
+            stemNames.add(stemName);
+
+            const auto stemFile = targetFile.getSiblingFile(targetFile.getFileNameWithoutExtension() +
+                " - " + stemName + targetFile.getFileExtension());
+
+            if (stemFile.exists() && !stemFile.deleteFile())
+            {
+                DBG("Failed to overwrite the stem: " + stemFile.getFullPathName());
+                continue;
+            }
+
+            subBuffer->stemWriter = this->createWriterFor(stemFile.createOutputStream());
+        }
+    }
+
     // release resources, prepare to play, etc
     for (auto *subBuffer : subBuffers)
     {
-        auto *graph = subBuffer->instrument->getProcessorGraph();
-
+        RenderPreparation preparation{ subBuffer->instrument->getProcessorGraph(),
+            numInChannels, numOutChannels, sampleRate, bufferSize,
+            subBuffer->isDoublePrecision ?
+                AudioProcessor::doublePrecision : AudioProcessor::singlePrecision };
+
+        // all of this is done on the message thread: LV2 plugins require that
+        // for setNonRealtime, and the graph only rebuilds its rendering sequence
+        // synchronously when prepared on the message thread (otherwise it posts
+        // an async update), so the graph is ready right away, no need to wait
         MessageManager::getInstance()->callFunctionOnMessageThread([](void *ptr) -> void *
         {
-            auto *graph = static_cast<AudioProcessorGraph *>(ptr);
-            graph->setNonRealtime(true); // LV2 plugins require doing this on the main thread
+            const auto *preparation = static_cast<RenderPreparation *>(ptr);
+            auto *graph = preparation->graph;
+            graph->setNonRealtime(true);
+            graph->reset();
+            graph->releaseResources();
+            graph->setPlayConfigDetails(preparation->numInChannels,
+                preparation->numOutChannels, preparation->sampleRate, preparation->blockSize);
+            graph->setProcessingPrecision(preparation->precision);
+            graph->prepareToPlay(graph->getSampleRate(), preparation->blockSize);
             return nullptr;
-        }, graph);
-
-        graph->reset();
-        graph->releaseResources();
-        graph->setPlayConfigDetails(numInChannels, numOutChannels, sampleRate, bufferSize);
-        graph->setProcessingPrecision(AudioProcessor::singlePrecision);
-        graph->prepareToPlay(graph->getSampleRate(), bufferSize);
+        }, &preparation);
     }
 
-    // let the processor graphs handle their async updates
-    Thread::sleep(200);
+    // the graphs are independent of each other, so they can be processed
+    // in parallel; the render thread itself is one of the workers
+    RenderWorkerPool workerPool(jmin(subBuffers.size(), SystemStats::getNumCpus()) - 1);
+
+    // the stems are written right away by the same workers,
+    // since the sub buffers are only read by the mixdown afterwards
+    const Function<void(int)> processSubBuffer = [this, &subBuffers, bufferSize](int index)
+    {
+        auto *subBuffer = subBuffers.getUnchecked(index);
+        subBuffer->processBlock();
+        if (!subBuffer->writeStem(bufferSize, *this) && !this->threadShouldExit())
+        {
+            this->renderFailed = true;
+        }
+    };
 
     // the render loop itself
-    
-    // TODO: add double precision rendering someday (for processor graphs who support it)
+
+    // in double precision mode, the mixing is also done in doubles,
+    // and the result is converted to floats only to be written
     AudioBuffer<float> mixingBuffer(numOutChannels, bufferSize);
+    AudioBuffer<double> doubleMixingBuffer(this->options.doublePrecision ? numOutChannels : 0,
+        this->options.doublePrecision ? bufferSize : 0);
     
     const auto firstEventTimestamp = nextMessage.message.getTimeStamp();
 
@@ -224,14 +684,7 @@ void RendererThread::run()
     for (auto *subBuffer : subBuffers)
     {
         subBuffer->midiBuffer.addEvent(midiStart, messageFrame);
-
-        auto *graph = subBuffer->instrument->getProcessorGraph();
-        {
-            const ScopedLock lock(graph->getCallbackLock());
-            graph->processBlock(subBuffer->sampleBuffer, subBuffer->midiBuffer);
-        }
-
-        subBuffer->midiBuffer.clear();
+        subBuffer->processBlock();
     }
 
     while (currentFrame < lastFrame)
@@ -279,47 +732,69 @@ void RendererThread::run()
         }
 
         // call processBlock for every instrument
-        for (auto *subBuffer : subBuffers)
+        workerPool.run(subBuffers.size(), processSubBuffer);
+
+        // mix them down to the render buffer, always in the same order,
+        // so that the result doesn't depend on which thread finished first
+        if (this->options.doublePrecision)
         {
-            auto *graph = subBuffer->instrument->getProcessorGraph();
+            doubleMixingBuffer.clear();
+
+            for (auto *subBuffer : subBuffers)
             {
-                const ScopedLock lock(graph->getCallbackLock());
-                graph->processBlock(subBuffer->sampleBuffer, subBuffer->midiBuffer);
+                for (int channel = 0; channel < numOutChannels; ++channel)
+                {
+                    if (subBuffer->isDoublePrecision)
+                    {
+                        doubleMixingBuffer.addFrom(channel, 0,
+                            subBuffer->doubleSampleBuffer, channel, 0,
+                            bufferSize,
+                            1.0);
+                    }
+                    else
+                    {
+                        auto *destination = doubleMixingBuffer.getWritePointer(channel);
+                        const auto *source = subBuffer->sampleBuffer.getReadPointer(channel);
+                        for (int i = 0; i < bufferSize; ++i)
+                        {
+                            destination[i] += double(source[i]);
+                        }
+                    }
+                }
             }
 
-            subBuffer->midiBuffer.clear();
-            //Thread::yield();
+            mixingBuffer.makeCopyOf(doubleMixingBuffer, true);
         }
-
-        // mix them down to the render buffer
-        mixingBuffer.clear();
-
-        for (auto *subBuffer : subBuffers)
+        else
         {
-            for (int channel = 0; channel < numOutChannels; ++channel)
+            mixingBuffer.clear();
+
+            for (auto *subBuffer : subBuffers)
             {
-                mixingBuffer.addFrom(channel, 0,
-                    subBuffer->sampleBuffer, channel, 0,
-                    bufferSize,
-                    1.f);
+                for (int channel = 0; channel < numOutChannels; ++channel)
+                {
+                    mixingBuffer.addFrom(channel, 0,
+                        subBuffer->sampleBuffer, channel, 0,
+                        bufferSize,
+                        1.f);
+                }
             }
         }
 
-        // write the resulting buffer to disk
-        // (make a few attempts and bail out if failed)
+        // pass the resulting buffer to the writer thread,
+        // which encodes and writes it while the next block is rendered
         {
             const ScopedLock lock(this->writerLock);
-            
-            bool writtenSuccessfully = false;
-            for (int i = 0; i < 10 && !writtenSuccessfully; ++i)
-            {
-                writtenSuccessfully =
-                    this->writer->writeFromAudioSampleBuffer(mixingBuffer, 0, mixingBuffer.getNumSamples());
-            }
 
-            if (!writtenSuccessfully)
+            if (!writeBlock(*this->writer, mixingBuffer, mixingBuffer.getNumSamples(), *this))
             {
-                jassert(false);
+                // either stopped, or the writer got stuck, e.g. the disk is full
+                // or the pipe reader is gone, and the file would be truncated
+                if (!this->threadShouldExit())
+                {
+                    this->renderFailed = true;
+                }
+
                 break;
             }
         }
@@ -369,11 +844,17 @@ void RendererThread::run()
     // whatever processing they need to do after resetting
     Thread::sleep(200);
     
+    // the threaded writers flush whatever is left in their fifos when deleted
     {
         const ScopedLock sl(this->writerLock);
         this->writer = nullptr;
     }
 
+    for (auto *subBuffer : subBuffers)
+    {
+        subBuffer->stemWriter = nullptr;
+    }
+
     // dispose the URL object, so that its security bookmark can be released by iOS
     this->renderTarget = {};
 
@@ -28,11 +28,20 @@ public:
     ~RendererThread() override;
     
     float getPercentsComplete() const noexcept;
+
+    // Before rendering, the renderer waits for the instruments to load,
+    // this is their average loading progress, or 1 if they're loaded
+    float getInstrumentsLoadingProgress() const noexcept;
+
+    // True if the last render has been cut short by the writer,
+    // not by stopping it, so that the output is incomplete
+    bool hasRenderFailed() const noexcept;
     const Array<float, CriticalSection> &getWaveformThumbnail() const;
 
     bool startRendering(const URL &target, RenderFormat format,
         Transport::PlaybackContext::Ptr context,
-        int waveformThumbnailResolution);
+        int waveformThumbnailResolution,
+        const RenderOptions &options = {});
 
     void stop();
     bool isRendering() const;
@@ -45,19 +54,30 @@ private:
 
     void run() override;
 
+    // The writer takes the ownership of the stream, if created;
+    // the encoding and the disk writes are done on the writer thread
+    using Writer = AudioFormatWriter::ThreadedWriter;
+    UniquePointer<Writer> createWriterFor(UniquePointer<OutputStream> stream);
+
 private:
 
     Transport &transport;
     Transport::PlaybackContext::Ptr context;
     RenderFormat format;
+    RenderOptions options;
 
     // this needs to be kept alive while rendering (why - because iOS)
     URL renderTarget;
 
     CriticalSection writerLock;
-    UniquePointer<AudioFormatWriter> writer;
+    UniquePointer<Writer> writer;
+
+    // shared by the mixdown writer and the stems writers
+    TimeSliceThread writerThread;
 
     Atomic<float> percentsDone = 0.f;
+    Atomic<float> instrumentsLoadingProgress = 1.f;
+    Atomic<bool> renderFailed = false;
 
     // the all-channels peaks-only low-resolution waveform preview,
     // simplest to compute, but good enough for the progress bar:
@@ -0,0 +1,130 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "TempoMap.h"
+
+TempoMap::TempoMap()
+{
+    this->nodes.push_back({ 0.0, 0.0, double(Globals::Defaults::msPerBeat) });
+}
+
+void TempoMap::update(const ReferenceCountedArray<CachedMidiSequence> &newTempoSequences,
+    float newFirstBeat)
+{
+    if (this->firstBeat == newFirstBeat &&
+        this->tempoSequences.size() == newTempoSequences.size())
+    {
+        bool hasChanges = false;
+        for (int i = 0; i < newTempoSequences.size(); ++i)
+        {
+            if (this->tempoSequences.getObjectPointerUnchecked(i) !=
+                newTempoSequences.getObjectPointerUnchecked(i))
+            {
+                hasChanges = true;
+                break;
+            }
+        }
+
+        if (!hasChanges)
+        {
+            return;
+        }
+    }
+
+    this->tempoSequences = newTempoSequences;
+    this->rebuild(newFirstBeat);
+}
+
+void TempoMap::rebuild(float newFirstBeat)
+{
+    this->firstBeat = newFirstBeat;
+
+    struct TempoEvent final
+    {
+        double beat;
+        double msPerBeat;
+    };
+
+    std::vector<TempoEvent> events;
+    for (const auto *sequence : this->tempoSequences)
+    {
+        for (int i = 0; i < sequence->midiMessages.getNumEvents(); ++i)
+        {
+            const auto &message = sequence->midiMessages.getEventPointer(i)->message;
+            if (message.isTempoMetaEvent())
+            {
+                events.push_back({ message.getTimeStamp(),
+                    message.getTempoSecondsPerQuarterNote() * 1000.0 });
+            }
+        }
+    }
+
+    // stable, so that the last one of the simultaneous events wins,
+    // same as in the playback, where the sequences are merged in order
+    std::stable_sort(events.begin(), events.end(),
+        [](const TempoEvent &a, const TempoEvent &b) { return a.beat < b.beat; });
+
+    const double initialTempo = events.empty() ?
+        double(Globals::Defaults::msPerBeat) : events.front().msPerBeat;
+
+    this->nodes.clear();
+    this->nodes.push_back({ double(newFirstBeat), 0.0, initialTempo });
+
+    for (const auto &event : events)
+    {
+        auto &last = this->nodes.back();
+        if (event.beat <= last.beat)
+        {
+            // simultaneous events, or the ones before the first beat
+            last.msPerBeat = event.msPerBeat;
+            continue;
+        }
+
+        const auto timeMs = last.timeMs + last.msPerBeat * (event.beat - last.beat);
+        this->nodes.push_back({ event.beat, timeMs, event.msPerBeat });
+    }
+}
+
+const TempoMap::Node &TempoMap::findNodeAtBeat(double beat) const noexcept
+{
+    // the last node at or before the beat, or the first one
+    const auto found = std::upper_bound(this->nodes.begin(), this->nodes.end(), beat,
+        [](double value, const Node &node) { return value < node.beat; });
+
+    return found == this->nodes.begin() ? *found : *(found - 1);
+}
+
+double TempoMap::getTimeMsAt(double beat) const noexcept
+{
+    const auto &node = this->findNodeAtBeat(beat);
+    return node.timeMs + node.msPerBeat * (beat - node.beat);
+}
+
+double TempoMap::getBeatAt(double timeMs) const noexcept
+{
+    const auto found = std::upper_bound(this->nodes.begin(), this->nodes.end(), timeMs,
+        [](double value, const Node &node) { return value < node.timeMs; });
+
+    const auto &node = found == this->nodes.begin() ? *found : *(found - 1);
+    return node.beat + (timeMs - node.timeMs) / node.msPerBeat;
+}
+
+double TempoMap::getTempoAt(double beat) const noexcept
+{
+    return this->findNodeAtBeat(beat).msPerBeat;
+}
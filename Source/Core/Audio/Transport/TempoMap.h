@@ -0,0 +1,68 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "TransportPlaybackCache.h"
+
+// A piecewise-linear mapping between beats and milliseconds,
+// built from the tempo events of the tempo tracks only: each node holds
+// the beat and the time where the tempo changes, and the new tempo,
+// so the conversions in both directions are binary searches.
+//
+// Before the first tempo event, the first event's tempo is used,
+// and with no tempo events at all, the default tempo is used.
+
+class TempoMap final
+{
+public:
+
+    TempoMap();
+
+    // Rebuilds the map if the tempo sequences or the first beat have changed
+    // since the last update; the exported sequences are immutable,
+    // so comparing the pointers is enough
+    void update(const ReferenceCountedArray<CachedMidiSequence> &tempoSequences,
+        float firstBeat);
+
+    double getTimeMsAt(double beat) const noexcept;
+    double getBeatAt(double timeMs) const noexcept;
+
+    // Milliseconds per beat, after all tempo events at or before the beat
+    double getTempoAt(double beat) const noexcept;
+
+private:
+
+    void rebuild(float firstBeat);
+
+    struct Node final
+    {
+        double beat;
+        double timeMs;
+        double msPerBeat;
+    };
+
+    // never empty, the first node is at the first beat
+    std::vector<Node> nodes;
+
+    const Node &findNodeAtBeat(double beat) const noexcept;
+
+    ReferenceCountedArray<CachedMidiSequence> tempoSequences;
+    float firstBeat = 0.f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TempoMap)
+};
@@ -56,6 +56,7 @@ Transport::~Transport()
     this->orchestra.removeOrchestraListener(this);
     this->project.getTimeline()->getTimeSignaturesAggregator()->removeListener(this);
     this->project.removeListener(this);
+    this->cancelPendingUpdate();
 
     this->renderer = nullptr;
     this->player = nullptr;
@@ -356,7 +357,7 @@ float Transport::getPlaybackLoopEnd() const noexcept
 //===----------------------------------------------------------------------===//
 
 bool Transport::startRender(const URL &renderTarget,
-    RenderFormat format, int thumbnailResolution)
+    RenderFormat format, int thumbnailResolution, const RenderOptions &options)
 {
     if (this->renderer->isRendering())
     {
@@ -365,7 +366,7 @@ bool Transport::startRender(const URL &renderTarget,
     
     return this->renderer->startRendering(renderTarget, format,
         this->fillPlaybackContextAt(this->getProjectFirstBeat()),
-        thumbnailResolution);
+        thumbnailResolution, options);
 }
 
 void Transport::stopRender()
@@ -388,6 +389,16 @@ float Transport::getRenderingPercentsComplete() const
     return this->renderer->getPercentsComplete();
 }
 
+float Transport::getRenderingInstrumentsLoadingProgress() const
+{
+    return this->renderer->getInstrumentsLoadingProgress();
+}
+
+bool Transport::hasRenderingFailed() const
+{
+    return this->renderer->hasRenderFailed();
+}
+
 const Array<float, CriticalSection> &Transport::getRenderingWaveformThumbnail() const
 {
     return this->renderer->getWaveformThumbnail();
@@ -639,7 +650,7 @@ void Transport::onMetronomeFlagChanged(bool enabled)
     // so we will have to rebuild it when the playback starts:
     this->isMetronomeEnabled = enabled;
     this->stopPlaybackAndRecording();
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCache();
 }
 
 //===----------------------------------------------------------------------===//
@@ -649,11 +660,8 @@ void Transport::onMetronomeFlagChanged(bool enabled)
 void Transport::onTimeSignaturesUpdated()
 {
     // almost same logic as in onMetronomeFlagChanged:
-    if (this->isMetronomeEnabled)
-    {
-        // this->stopPlaybackAndRecording(); // that's kinda too intrusive
-        this->playbackCacheIsOutdated = true;
-    }
+    // this->stopPlaybackAndRecording(); // that's kinda too intrusive
+    this->invalidatePlaybackCacheForMetronome();
 }
 
 //===----------------------------------------------------------------------===//
@@ -665,7 +673,7 @@ void Transport::onAddInstrument(Instrument *instrument)
     this->stopPlaybackAndRecording();
 
     // invalidate cache as is uses pointers to the players too
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCache();
 
     for (int i = 0; i < this->tracksCache.size(); ++i)
     {
@@ -682,7 +690,7 @@ void Transport::onRemoveInstrument(Instrument *instrument)
 
 void Transport::onPostRemoveInstrument()
 {
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCache();
 
     for (int i = 0; i < this->tracksCache.size(); ++i)
     {
@@ -705,44 +713,32 @@ void Transport::handlePossibleTempoChange(int trackControllerNumber)
 
 void Transport::onChangeMidiEvent(const MidiEvent &oldEvent, const MidiEvent &newEvent)
 {
-    // relying on isRecording() sucks,
-    // but I don't see any easy workaround at the moment:
-    if (!this->isRecording())
-    {
-        this->stopPlayback();
-    }
-
-    this->playbackCacheIsOutdated = true;
+    // the player keeps playing, and will pick up the rebuilt cache,
+    // see handleAsyncUpdate (this also works while recording)
+    this->invalidatePlaybackCacheFor(newEvent.getSequence()->getTrack());
+    this->triggerAsyncUpdate();
     this->handlePossibleTempoChange(newEvent.getTrackControllerNumber());
 }
 
 void Transport::onAddMidiEvent(const MidiEvent &event)
 {
-    if (!this->isRecording())
-    {
-        this->stopPlayback();
-    }
-
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(event.getSequence()->getTrack());
+    this->triggerAsyncUpdate();
     this->handlePossibleTempoChange(event.getTrackControllerNumber());
 }
 
 void Transport::onRemoveMidiEvent(const MidiEvent &event) {}
 void Transport::onPostRemoveMidiEvent(MidiSequence *const sequence)
 {
-    this->stopPlaybackAndRecording();
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(sequence->getTrack());
+    this->triggerAsyncUpdate();
     this->handlePossibleTempoChange(sequence->getTrack()->getTrackControllerNumber());
 }
 
 void Transport::onAddClip(const Clip &clip)
 {
-    if (!this->isRecording())
-    {
-        this->stopPlayback();
-    }
-
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(clip);
+    this->triggerAsyncUpdate();
     this->handlePossibleTempoChange(clip.getTrackControllerNumber());
 
     if (clip.isSoloed())
@@ -753,8 +749,8 @@ void Transport::onAddClip(const Clip &clip)
 
 void Transport::onChangeClip(const Clip &oldClip, const Clip &newClip)
 {
-    this->stopPlaybackAndRecording();
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(newClip);
+    this->triggerAsyncUpdate();
     this->handlePossibleTempoChange(newClip.getTrackControllerNumber());
 
     if (oldClip.isSoloed() != newClip.isSoloed())
@@ -763,29 +759,38 @@ void Transport::onChangeClip(const Clip &oldClip, const Clip &newClip)
     }
 }
 
-void Transport::onRemoveClip(const Clip &clip) {}
+void Transport::onRemoveClip(const Clip &clip)
+{
+    this->invalidatePlaybackCacheFor(clip);
+    this->triggerAsyncUpdate();
+}
+
 void Transport::onPostRemoveClip(Pattern *const pattern)
 {
-    this->stopPlaybackAndRecording();
-    this->playbackCacheIsOutdated = true;
     this->handlePossibleTempoChange(pattern->getTrack()->getTrackControllerNumber());
     this->hasSoloClipsCache = this->findSoloClipFlagIfAny();
 }
 
+void Transport::onReloadGeneratedSequence(const Clip &clip,
+    MidiSequence *const generatedSequence)
+{
+    this->invalidatePlaybackCacheFor(clip);
+    this->triggerAsyncUpdate();
+}
+
 void Transport::onChangeTrackProperties(MidiTrack *const track)
 {
-    // Stop playback only when instrument changes:
+    // the cached clips have the track's channel and controller number
+    // baked into their messages, so any property change outdates them
+    this->invalidatePlaybackCacheFor(track);
+
     if (!instrumentLinks.contains(track->getTrackId()) ||
         this->instrumentLinks[track->getTrackId()]->getInstrumentId() != track->getTrackInstrumentId())
     {
-        if (!this->isRecording())
-        {
-            this->stopPlayback();
-        }
-
-        this->playbackCacheIsOutdated = true;
         this->updateInstrumentLinkForTrack(track);
     }
+
+    this->triggerAsyncUpdate();
 }
 
 void Transport::updateTemperamentForBuiltInSynth(Temperament::Ptr temperament) const
@@ -813,7 +818,7 @@ void Transport::onActivateProjectSubtree(const ProjectMetadata *meta)
 
     // let's reset midi caches, just in case some instrument's keyboard mapping
     // has changed in the meanwhile (no idea how to observe kbm changes in transport)
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCache();
 }
 
 void Transport::onChangeProjectInfo(const ProjectMetadata *meta)
@@ -824,7 +829,7 @@ void Transport::onChangeProjectInfo(const ProjectMetadata *meta)
 void Transport::onReloadProjectContent(const Array<MidiTrack *> &tracks,
     const ProjectMetadata *meta)
 {
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCache();
 
     this->tracksCache.clearQuick();
     this->instrumentLinks.clear();
@@ -844,36 +849,30 @@ void Transport::onReloadProjectContent(const Array<MidiTrack *> &tracks,
 
 void Transport::onAddTrack(MidiTrack *const track)
 {
-    if (!this->isRecording())
-    {
-        this->stopPlayback();
-    }
-
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(track);
     this->tracksCache.addIfNotAlreadyThere(track);
     this->updateInstrumentLinkForTrack(track);
     this->hasSoloClipsCache = this->findSoloClipFlagIfAny();
+    this->triggerAsyncUpdate();
 }
 
 void Transport::onRemoveTrack(MidiTrack *const track)
 {
-    this->stopPlaybackAndRecording();
-
-    this->playbackCacheIsOutdated = true;
+    this->invalidatePlaybackCacheFor(track);
     this->tracksCache.removeAllInstancesOf(track);
     this->clearInstrumentLinkForTrack(track);
     this->hasSoloClipsCache = this->findSoloClipFlagIfAny();
+    this->triggerAsyncUpdate();
 }
 
 void Transport::onChangeProjectBeatRange(float firstBeat, float lastBeat)
 {
-    if (!this->isRecording())
-    {
-        this->stopPlayback();
-    }
-
     this->projectFirstBeat = firstBeat;
     this->projectLastBeat = lastBeat;
+
+    // the metronome spans the whole project
+    this->invalidatePlaybackCacheForMetronome();
+    this->triggerAsyncUpdate();
     
     // real track total time changed
     const auto realLengthMs = this->findTimeAt(lastBeat);
@@ -886,131 +885,48 @@ void Transport::onChangeProjectBeatRange(float firstBeat, float lastBeat)
 
 double Transport::findTimeAt(float targetBeat) const
 {
-    double resultTimeMs = 0.0;
-
-    this->rebuildPlaybackCacheIfNeeded();
-
-    CachedMidiMessage cached;
-
-    // try to find the initial value for global tempo
-    // by picking the very first tempo automation event, if present
-    double tempo = Globals::Defaults::msPerBeat;
-
-    this->playbackCache.seekToStart();
-    while (this->playbackCache.getNextMessage(cached))
-    {
-        if (cached.message.isTempoMetaEvent())
-        {
-            tempo = cached.message.getTempoSecondsPerQuarterNote() * 1000.f;
-            break;
-        }
-    }
-
-    double prevTimestamp = this->projectFirstBeat.get();
-
-    this->playbackCache.seekToStart();
-    while (this->playbackCache.getNextMessage(cached))
-    {
-        const auto nextTimestamp = cached.message.getTimeStamp();
-
-        if (nextTimestamp > targetBeat)
-        {
-            break;
-        }
-
-        const auto nextEventTimeDelta = tempo * (nextTimestamp - prevTimestamp);
-        resultTimeMs += nextEventTimeDelta;
-        prevTimestamp = nextTimestamp;
-
-        if (cached.message.isTempoMetaEvent())
-        {
-            tempo = cached.message.getTempoSecondsPerQuarterNote() * 1000.f;
-        }
-    }
-
-    // add remainder, the time from the last event to the given beat:
-    resultTimeMs += (tempo * (targetBeat - prevTimestamp));
-
-    return resultTimeMs;
+    return this->getTempoMap().getTimeMsAt(targetBeat);
 }
 
 Transport::PlaybackContext::Ptr Transport::fillPlaybackContextAt(float targetBeat) const
 {
-    this->rebuildPlaybackCacheIfNeeded();
-
-    CachedMidiMessage cached;
-
-    // try to find the initial value for global tempo
-    // by picking the very first tempo automation event, if present
-    double tempo = Globals::Defaults::msPerBeat;
-
-    this->playbackCache.seekToStart();
-    while (this->playbackCache.getNextMessage(cached))
-    {
-        if (cached.message.isTempoMetaEvent())
-        {
-            tempo = cached.message.getTempoSecondsPerQuarterNote() * 1000.f;
-            break;
-        }
-    }
+    const auto &tempoMap = this->getTempoMap();
 
     Transport::PlaybackContext::Ptr context(new Transport::PlaybackContext());
     context->startBeat = targetBeat;
 
-    context->totalTimeMs = 0.0;
-    context->startBeatTimeMs = 0.0;
-    context->startBeatTempo = tempo;
+    context->startBeatTempo = tempoMap.getTempoAt(targetBeat);
+    context->startBeatTimeMs = tempoMap.getTimeMsAt(targetBeat);
+    context->totalTimeMs = tempoMap.getTimeMsAt(this->projectLastBeat.get());
 
     context->sampleRate = this->playbackCache.getSampleRate();
     context->numOutputChannels = this->playbackCache.getNumOutputChannels();
 
-    double prevTimestamp = this->projectFirstBeat.get();
-    bool startBeatPassed = false;
+    // each sequence only replays its events from the nearest checkpoint,
+    // and when several sequences set the same controller, the latest value wins,
+    // or the one from the latter sequence, same as in the merged playback order
+    double ccBeats[PlaybackContext::numCCs + 1][Globals::numChannels];
 
-    this->playbackCache.seekToStart();
-    while (this->playbackCache.getNextMessage(cached))
+    for (const auto *sequence : this->playbackCache.getAllFor(nullptr))
     {
-        const auto nextTimestamp = cached.message.getTimeStamp();
-        const auto nextEventTimeDelta = tempo * (nextTimestamp - prevTimestamp);
-
-        if (nextTimestamp > context->startBeat)
+        sequence->findControllerStatesAt(targetBeat,
+            [&context, &ccBeats](int controller, int channel, int value, double beat)
         {
-            // the time from the last event to the given beat:
-            context->startBeatTimeMs += (tempo * (context->startBeat - prevTimestamp));
-            startBeatPassed = true;
-        }
-
-        if (!startBeatPassed)
-        {
-            context->startBeatTimeMs += nextEventTimeDelta;
-        }
-
-        context->totalTimeMs += nextEventTimeDelta;
-        prevTimestamp = nextTimestamp;
-
-        if (cached.message.isTempoMetaEvent())
-        {
-            tempo = cached.message.getTempoSecondsPerQuarterNote() * 1000.f;
-        }
-        else if (!startBeatPassed &&
-            cached.message.isController() &&
-            cached.message.getControllerNumber() <= PlaybackContext::numCCs)
-        {
-            const auto channel = jlimit(0, Globals::numChannels - 1, cached.message.getChannel() - 1);
-            context->ccStates[cached.message.getControllerNumber()][channel] =
-                cached.message.getControllerValue();
-        }
+            if (controller > PlaybackContext::numCCs)
+            {
+                return;
+            }
 
-        if (!startBeatPassed)
-        {
-            context->startBeatTempo = tempo;
-        }
+            auto &state = context->ccStates[controller][channel - 1];
+            auto &stateBeat = ccBeats[controller][channel - 1];
+            if (state < 0 || beat >= stateBeat)
+            {
+                state = value;
+                stateBeat = beat;
+            }
+        });
     }
 
-    // the remainder
-    context->totalTimeMs += (tempo * (this->projectLastBeat.get() - prevTimestamp));
-    //jassert(context->totalTimeMs == this->findTimeAt(this->projectLastBeat.get()));
-
     return context;
 }
 
@@ -1034,11 +950,73 @@ bool Transport::findSoloClipFlagIfAny() const
 
 void Transport::rebuildPlaybackCacheIfNeeded() const
 {
-    if (this->playbackCacheIsOutdated.get())
+    if (!this->playbackCacheIsOutdated.get())
     {
-        this->playbackCache = this->buildPlaybackCache(this->isMetronomeEnabled);
-        this->playbackCacheIsOutdated = false;
+        return;
+    }
+
+    // the solo flag affects all clips' exports
+    this->hasSoloClipsCache = this->findSoloClipFlagIfAny();
+    if (this->hasSoloClipsCache != this->cachedClipsHaveSoloClips)
+    {
+        this->cachedClips.clear();
+        this->cachedClipsHaveSoloClips = this->hasSoloClipsCache;
+    }
+
+    TransportPlaybackCache result;
+    FlatHashMap<String, CachedMidiSequence::Ptr, StringHash> updatedClips;
+    this->tempoSequences.clearQuick();
+
+    // the clips which are not found in the project anymore are dropped here,
+    // and those which are up to date are just picked from the previous cache
+    const auto addClip = [&](const MidiTrack *track, const Clip &clip)
+    {
+        const auto key = Transport::getCachedClipKey(track->getTrackId(), clip);
+        const auto found = this->cachedClips.find(key);
+
+        CachedMidiSequence::Ptr cached;
+        if (found != this->cachedClips.end() &&
+            !this->outdatedClips.contains(key) &&
+            !this->outdatedTracks.contains(track->getTrackId()))
+        {
+            cached = found->second;
+        }
+        else
+        {
+            cached = this->exportClip(track, clip, this->isMetronomeEnabled);
+        }
+
+        if (track->isTempoTrack())
+        {
+            this->tempoSequences.add(cached);
+        }
+
+        updatedClips[key] = cached;
+        result.addWrapper(cached);
+    };
+
+    for (const auto *track : this->tracksCache)
+    {
+        if (track->getPattern() != nullptr)
+        {
+            for (const auto *clip : track->getPattern()->getClips())
+            {
+                addClip(track, *clip);
+            }
+        }
+        else
+        {
+            static Clip noTransform;
+            addClip(track, noTransform);
+        }
     }
+
+    this->cachedClips = move(updatedClips);
+    this->outdatedTracks.clear();
+    this->outdatedClips.clear();
+
+    this->playbackCache = move(result);
+    this->playbackCacheIsOutdated = false;
 }
 
 TransportPlaybackCache Transport::buildPlaybackCache(bool withMetronome) const
@@ -1046,44 +1024,97 @@ TransportPlaybackCache Transport::buildPlaybackCache(bool withMetronome) const
     TransportPlaybackCache result;
     
     this->hasSoloClipsCache = this->findSoloClipFlagIfAny();
-    auto &generatedSequences = *this->project.getGeneratedSequences();
 
     for (const auto *track : this->tracksCache)
     {
-        const auto instrument = this->instrumentLinks[track->getTrackId()];
-        jassert(instrument != nullptr);
-        const auto &keyMapping = *instrument->getKeyboardMapping();
-
-        auto cached = CachedMidiSequence::createFrom(instrument, track->getSequence());
-
         if (track->getPattern() != nullptr)
         {
             for (const auto *clip : track->getPattern()->getClips())
             {
-                cached->sequence->exportMidi(cached->midiMessages, *clip,
-                    keyMapping, generatedSequences,
-                    this->hasSoloClipsCache, withMetronome,
-                    this->projectFirstBeat.get(), this->projectLastBeat.get());
+                result.addWrapper(this->exportClip(track, *clip, withMetronome));
             }
         }
         else
         {
             static Clip noTransform;
-            cached->sequence->exportMidi(cached->midiMessages, noTransform,
-                keyMapping, generatedSequences,
-                this->hasSoloClipsCache, withMetronome,
-                this->projectFirstBeat.get(), this->projectLastBeat.get());
+            result.addWrapper(this->exportClip(track, noTransform, withMetronome));
         }
-
-        result.addWrapper(cached);
     }
 
     return result;
 }
 
+CachedMidiSequence::Ptr Transport::exportClip(const MidiTrack *track,
+    const Clip &clip, bool withMetronome) const
+{
+    const auto instrument = this->instrumentLinks[track->getTrackId()];
+    jassert(instrument != nullptr);
+    const auto &keyMapping = *instrument->getKeyboardMapping();
+
+    auto cached = CachedMidiSequence::createFrom(instrument, track->getSequence());
+
+    cached->sequence->exportMidi(cached->midiMessages, clip,
+        keyMapping, *this->project.getGeneratedSequences(),
+        this->hasSoloClipsCache, withMetronome,
+        this->projectFirstBeat.get(), this->projectLastBeat.get());
+
+    cached->updateControllerCheckpoints();
+    return cached;
+}
+
+String Transport::getCachedClipKey(const String &trackId, const Clip &clip)
+{
+    return trackId + ":" + String(clip.getId());
+}
+
+void Transport::invalidatePlaybackCache()
+{
+    this->cachedClips.clear();
+    this->playbackCacheIsOutdated = true;
+}
+
+void Transport::invalidatePlaybackCacheFor(const MidiTrack *track)
+{
+    this->outdatedTracks.insert(track->getTrackId());
+    this->playbackCacheIsOutdated = true;
+}
+
+void Transport::invalidatePlaybackCacheFor(const Clip &clip)
+{
+    this->outdatedClips.insert(Transport::getCachedClipKey(clip.getTrackId(), clip));
+    this->playbackCacheIsOutdated = true;
+}
+
+void Transport::invalidatePlaybackCacheForMetronome()
+{
+    // the metronome is exported along with the time signatures track
+    if (this->isMetronomeEnabled)
+    {
+        this->invalidatePlaybackCacheFor(this->project.getTimeline()->getTimeSignatures());
+    }
+}
+
+void Transport::handleAsyncUpdate()
+{
+    // no need to check if the cache is outdated: it might have been rebuilt
+    // in the meanwhile, e.g. by findTimeAt, but the player still has the old one
+    if (this->isPlaying())
+    {
+        this->rebuildPlaybackCacheIfNeeded();
+        this->player->updatePlaybackCache(this->getPlaybackCache());
+    }
+}
+
+const TempoMap &Transport::getTempoMap() const
+{
+    this->rebuildPlaybackCacheIfNeeded();
+    this->tempoMap.update(this->tempoSequences, this->projectFirstBeat.get());
+    return this->tempoMap;
+}
+
 // returning by value, because it will be used by (possibly many) player threads,
 // so we'd rather play safe and just let them deal with their own copy of it;
-// internally, the data is refcounted anyway and protected by critical sections
+// internally, the exported events are refcounted and shared, only the cursors are copied
 TransportPlaybackCache Transport::getPlaybackCache()
 {
     return this->playbackCache;
@@ -25,6 +25,7 @@ class RendererThread;
 
 #include "TransportListener.h"
 #include "TransportPlaybackCache.h"
+#include "TempoMap.h"
 #include "TimeSignaturesAggregator.h"
 #include "OrchestraListener.h"
 #include "ProjectListener.h"
@@ -38,7 +39,8 @@ class Transport final : public Serializable,
     public ProjectListener,
     public OrchestraListener,
     public TimeSignaturesAggregator::Listener,
-    public UserInterfaceFlags::Listener // needs the metronome on/off flag changes
+    public UserInterfaceFlags::Listener, // needs the metronome on/off flag changes
+    private AsyncUpdater // sends the edited playback cache to the player
 {
 public:
 
@@ -78,7 +80,8 @@ public:
     bool isPlayingAndRecording() const;
     void stopPlaybackAndRecording();
 
-    bool startRender(const URL &renderTarget, RenderFormat format, int thumbnailResolution);
+    bool startRender(const URL &renderTarget, RenderFormat format,
+        int thumbnailResolution, const RenderOptions &options = {});
     bool isRendering() const;
     void stopRender();
     
@@ -89,6 +92,8 @@ public:
     float getPlaybackLoopEnd() const noexcept;
 
     float getRenderingPercentsComplete() const;
+    float getRenderingInstrumentsLoadingProgress() const;
+    bool hasRenderingFailed() const;
     const Array<float, CriticalSection> &getRenderingWaveformThumbnail() const;
 
     //===------------------------------------------------------------------===//
@@ -192,6 +197,8 @@ public:
     void onChangeClip(const Clip &oldClip, const Clip &newClip) override;
     void onRemoveClip(const Clip &clip) override;
     void onPostRemoveClip(Pattern *const pattern) override;
+    void onReloadGeneratedSequence(const Clip &clip,
+        MidiSequence *const generatedSequence) override;
 
     void onAddTrack(MidiTrack *const track) override;
     void onRemoveTrack(MidiTrack *const track) override;
@@ -254,6 +261,30 @@ private:
     void rebuildPlaybackCacheIfNeeded() const;
     TransportPlaybackCache buildPlaybackCache(bool withMetronome) const;
 
+    // the playback cache is made of one cached sequence per clip,
+    // and only the outdated ones are exported again on rebuild;
+    // <track id + clip id : cached sequence>
+    mutable FlatHashMap<String, CachedMidiSequence::Ptr, StringHash> cachedClips;
+    mutable FlatHashSet<String, StringHash> outdatedTracks;
+    mutable FlatHashSet<String, StringHash> outdatedClips;
+    mutable bool cachedClipsHaveSoloClips = false;
+
+    // the beat to time conversions only need the tempo tracks' clips,
+    // and the map is only rebuilt when any of them was exported again
+    mutable ReferenceCountedArray<CachedMidiSequence> tempoSequences;
+    mutable TempoMap tempoMap;
+    const TempoMap &getTempoMap() const;
+
+    void invalidatePlaybackCache();
+    void invalidatePlaybackCacheFor(const MidiTrack *track);
+    void invalidatePlaybackCacheFor(const Clip &clip);
+    void invalidatePlaybackCacheForMetronome();
+
+    CachedMidiSequence::Ptr exportClip(const MidiTrack *track,
+        const Clip &clip, bool withMetronome) const;
+
+    static String getCachedClipKey(const String &trackId, const Clip &clip);
+
     mutable bool hasSoloClipsCache = false;
     bool findSoloClipFlagIfAny() const;
 
@@ -269,6 +300,14 @@ private:
 
     inline void handlePossibleTempoChange(int trackControllerNumber);
 
+    //===------------------------------------------------------------------===//
+    // AsyncUpdater
+    //===------------------------------------------------------------------===//
+
+    // the edits come in batches, e.g. when dragging a selection of notes,
+    // so the playback cache is rebuilt and hot-swapped once per batch
+    void handleAsyncUpdate() override;
+
 private:
 
     class NotePreviewTimer final : private Timer
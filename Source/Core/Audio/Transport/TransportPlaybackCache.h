@@ -21,10 +21,12 @@
 
 class MidiSequence;
 
+// The exported events are never modified after the cache is built,
+// so they are shared between all copies of the cache, i.e. the snapshots
+// used by the player threads, and only the cursors are per-copy
 struct CachedMidiSequence final : public ReferenceCountedObject
 {
     MidiMessageSequence midiMessages;
-    int currentIndex;
     MidiMessageCollector *listener;
     Instrument *instrument;
     const MidiSequence *sequence;
@@ -36,11 +38,150 @@ struct CachedMidiSequence final : public ReferenceCountedObject
         jassert(instrument != nullptr);
         CachedMidiSequence::Ptr wrapper(new CachedMidiSequence());
         wrapper->sequence = sequence;
-        wrapper->currentIndex = 0;
         wrapper->instrument = instrument;
         wrapper->listener = &instrument->getProcessorPlayer().getMidiMessageCollector();
         return wrapper;
     }
+
+    //===------------------------------------------------------------------===//
+    // Controller checkpoints
+    //===------------------------------------------------------------------===//
+
+    // To restore the controller states at the playback start, only the events
+    // from the nearest checkpoint need to be replayed, not the whole sequence;
+    // the checkpoints are only built for the sequences with controller events,
+    // i.e. automation tracks, and must be updated after the events are exported
+    void updateControllerCheckpoints()
+    {
+        this->controllers.clear();
+        this->checkpoints.clear();
+
+        for (int i = 0; i < this->midiMessages.getNumEvents(); ++i)
+        {
+            const auto &message = this->midiMessages.getEventPointer(i)->message;
+            if (message.isController())
+            {
+                const auto controller = CachedMidiSequence::getControllerKey(message);
+                if (std::find(this->controllers.begin(), this->controllers.end(),
+                    controller) == this->controllers.end())
+                {
+                    this->controllers.push_back(controller);
+                }
+            }
+        }
+
+        if (this->controllers.empty())
+        {
+            return;
+        }
+
+        std::vector<ControllerState> states(this->controllers.size());
+        auto nextCheckpointBeat = std::floor(this->midiMessages.getStartTime() /
+            CachedMidiSequence::checkpointIntervalBeats) * CachedMidiSequence::checkpointIntervalBeats;
+
+        for (int i = 0; i < this->midiMessages.getNumEvents(); ++i)
+        {
+            const auto &message = this->midiMessages.getEventPointer(i)->message;
+
+            // each checkpoint has the states before its beat
+            while (message.getTimeStamp() >= nextCheckpointBeat)
+            {
+                this->checkpoints.push_back({ nextCheckpointBeat, i, states });
+                nextCheckpointBeat += CachedMidiSequence::checkpointIntervalBeats;
+            }
+
+            if (message.isController())
+            {
+                auto &state = states[this->findControllerIndex(message)];
+                state.beat = message.getTimeStamp();
+                state.value = message.getControllerValue();
+            }
+        }
+    }
+
+    // Calls back with (controller number, channel, value, beat) for the last
+    // value of each of the sequence's controllers at or before the given beat
+    template <typename Callback>
+    void findControllerStatesAt(double beat, Callback callback) const
+    {
+        if (this->controllers.empty())
+        {
+            return;
+        }
+
+        std::vector<ControllerState> states(this->controllers.size());
+        int startIndex = 0;
+
+        const auto checkpoint = std::upper_bound(this->checkpoints.begin(), this->checkpoints.end(),
+            beat, [](double value, const ControllerCheckpoint &c) { return value < c.beat; });
+
+        if (checkpoint != this->checkpoints.begin())
+        {
+            states = (checkpoint - 1)->states;
+            startIndex = (checkpoint - 1)->eventIndex;
+        }
+
+        for (int i = startIndex; i < this->midiMessages.getNumEvents(); ++i)
+        {
+            const auto &message = this->midiMessages.getEventPointer(i)->message;
+            if (message.getTimeStamp() > beat)
+            {
+                break;
+            }
+
+            if (message.isController())
+            {
+                auto &state = states[this->findControllerIndex(message)];
+                state.beat = message.getTimeStamp();
+                state.value = message.getControllerValue();
+            }
+        }
+
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            if (states[i].value >= 0)
+            {
+                callback(this->controllers[i] >> 8,
+                    (this->controllers[i] & 0xff) + 1,
+                    states[i].value, states[i].beat);
+            }
+        }
+    }
+
+private:
+
+    static constexpr auto checkpointIntervalBeats = double(Globals::beatsPerBar * 4);
+
+    struct ControllerState final
+    {
+        double beat = 0.0;
+        int value = -1;
+    };
+
+    struct ControllerCheckpoint final
+    {
+        double beat;
+        int eventIndex; // the first event at or after the beat
+        std::vector<ControllerState> states;
+    };
+
+    // controller number << 8 | (channel - 1)
+    std::vector<int> controllers;
+    std::vector<ControllerCheckpoint> checkpoints;
+
+    static int getControllerKey(const MidiMessage &message) noexcept
+    {
+        const auto channel = jlimit(1, Globals::numChannels, message.getChannel());
+        return (message.getControllerNumber() << 8) | (channel - 1);
+    }
+
+    size_t findControllerIndex(const MidiMessage &message) const noexcept
+    {
+        const auto key = CachedMidiSequence::getControllerKey(message);
+        const auto found = std::find(this->controllers.begin(), this->controllers.end(), key);
+        jassert(found != this->controllers.end());
+        return size_t(found - this->controllers.begin());
+    }
 };
 
 struct CachedMidiMessage final : public ReferenceCountedObject
@@ -58,6 +199,31 @@ private:
     Array<Instrument *, CriticalSection> uniqueInstruments;
     ReferenceCountedArray<CachedMidiSequence, CriticalSection> sequences;
 
+    // the playback position in each of the sequences
+    std::vector<int> currentIndices;
+
+    // The k-way merge of the cached sequences: a binary min-heap with one
+    // entry per sequence which still has events, ordered by the timestamp
+    // of the next event, and by the sequence index for equal timestamps
+    // (so the events order is the same as the old linear scan's one);
+    // it is rebuilt lazily after any seek or change of the sequences
+    struct MergeHeapEntry final
+    {
+        double timeStamp;
+        int sequenceIndex;
+        const CachedMidiSequence *wrapper;
+
+        inline bool isBefore(const MergeHeapEntry &other) const noexcept
+        {
+            return this->timeStamp < other.timeStamp ||
+                (this->timeStamp == other.timeStamp &&
+                    this->sequenceIndex < other.sequenceIndex);
+        }
+    };
+
+    std::vector<MergeHeapEntry> mergeHeap;
+    bool mergeHeapIsOutdated = true;
+
 public:
     
     TransportPlaybackCache() = default;
@@ -66,18 +232,26 @@ public:
     {
         this->sequences.addArray(other.sequences);
         this->uniqueInstruments.addArray(other.uniqueInstruments);
+        this->currentIndices = other.currentIndices;
+        this->mergeHeapIsOutdated = true;
     }
 
     TransportPlaybackCache(TransportPlaybackCache &&other) noexcept
     {
         this->sequences.swapWith(other.sequences);
         this->uniqueInstruments.swapWith(other.uniqueInstruments);
+        this->currentIndices.swap(other.currentIndices);
+        this->mergeHeap.swap(other.mergeHeap);
+        std::swap(this->mergeHeapIsOutdated, other.mergeHeapIsOutdated);
     }
 
     TransportPlaybackCache &operator= (TransportPlaybackCache &&other) noexcept
     {
         this->sequences.swapWith(other.sequences);
         this->uniqueInstruments.swapWith(other.uniqueInstruments);
+        this->currentIndices.swap(other.currentIndices);
+        this->mergeHeap.swap(other.mergeHeap);
+        std::swap(this->mergeHeapIsOutdated, other.mergeHeapIsOutdated);
         return *this;
     }
 
@@ -92,6 +266,8 @@ public:
         {
             this->uniqueInstruments.addIfNotAlreadyThere(newWrapper->instrument);
             this->sequences.add(newWrapper);
+            this->currentIndices.push_back(0);
+            this->mergeHeapIsOutdated = true;
         }
     }
     
@@ -99,6 +275,9 @@ public:
     {
         this->uniqueInstruments.clearQuick();
         this->sequences.clearQuick();
+        this->currentIndices.clear();
+        this->mergeHeap.clear();
+        this->mergeHeapIsOutdated = true;
     }
     
     inline bool isEmpty() const
@@ -156,77 +335,232 @@ public:
 
     void seekToTime(double position)
     {
-        for (auto *wrapper : this->sequences)
+        for (int i = 0; i < this->sequences.size(); ++i)
         {
-            wrapper->currentIndex = this->getNextIndexAtTime(wrapper->midiMessages, (position - DBL_MIN));
+            this->currentIndices[i] = TransportPlaybackCache::getNextIndexAtTime(
+                this->sequences.getObjectPointerUnchecked(i)->midiMessages,
+                this->currentIndices[i], (position - DBL_MIN));
         }
+
+        this->mergeHeapIsOutdated = true;
     }
     
     void seekToStart()
     {
-        for (auto *wrapper : this->sequences)
-        {
-            wrapper->currentIndex = 0;
-        }
+        std::fill(this->currentIndices.begin(), this->currentIndices.end(), 0);
+
+        this->mergeHeapIsOutdated = true;
     }
     
+    // Each step is O(log sequences) and takes no locks, assuming that
+    // only one thread iterates this cache instance, which is the case for
+    // the player and the renderer threads, since they both own a copy of it,
+    // including the cursors, so seeking the transport's copy, e.g. in
+    // findTimeAt, doesn't move them; the sequences lock is only taken
+    // when the heap needs rebuilding
     bool getNextMessage(CachedMidiMessage &target)
     {
-        double minTimeStamp = DBL_MAX;
-        int targetSequenceIndex = -1;
+        if (this->mergeHeapIsOutdated)
+        {
+            this->rebuildMergeHeap();
+        }
+
+        if (this->mergeHeap.empty())
+        {
+            return false;
+        }
 
-        // let's lock it manually one time here to avoid 3 separate locks below,
-        // CriticalSection is re-entrant, and the profiler shows it's faster:
+        auto &top = this->mergeHeap.front();
+        const auto *foundWrapper = top.wrapper;
+        auto &currentIndex = this->currentIndices[top.sequenceIndex];
+        jassert(currentIndex < foundWrapper->midiMessages.getNumEvents());
+
+        const auto &foundMessage = foundWrapper->midiMessages.getEventPointer(currentIndex)->message;
+        currentIndex++;
+
+        target.message = foundMessage;
+        target.listener = foundWrapper->listener;
+        target.instrument = foundWrapper->instrument;
+
+        if (currentIndex < foundWrapper->midiMessages.getNumEvents())
+        {
+            top.timeStamp = foundWrapper->midiMessages.getEventPointer(currentIndex)->message.getTimeStamp();
+        }
+        else
+        {
+            top = this->mergeHeap.back();
+            this->mergeHeap.pop_back();
+        }
+
+        this->siftDown(0);
+        return true;
+    }
+    
+    // Checks if the note which is currently held by the listener will be
+    // released by one of the events after the current playback position;
+    // used when the playback switches to an edited copy of the cache,
+    // where the held note could have been deleted or made shorter
+    bool hasPendingNoteOff(const MidiMessageCollector *listener, int channel, int key) const
+    {
         const CriticalSection::ScopedLockType lock(this->sequences.getLock());
 
         for (int i = 0; i < this->sequences.size(); ++i)
         {
-            const auto *wrapper = this->sequences.getObjectPointer(i);
-            if (wrapper->currentIndex < wrapper->midiMessages.getNumEvents())
+            const auto *wrapper = this->sequences.getObjectPointerUnchecked(i);
+            if (wrapper->listener != listener)
             {
-                const auto &message = wrapper->midiMessages.getEventPointer(wrapper->currentIndex)->message;
+                continue;
+            }
 
-                if (message.getTimeStamp() < minTimeStamp)
+            // only the first event for this key counts: if it's a note-on,
+            // the held note would be either re-triggered or never released
+            for (int j = this->currentIndices[i]; j < wrapper->midiMessages.getNumEvents(); ++j)
+            {
+                const auto &message = wrapper->midiMessages.getEventPointer(j)->message;
+                if (message.isNoteOnOrOff() &&
+                    message.getNoteNumber() == key &&
+                    message.getChannel() == channel)
                 {
-                    minTimeStamp = message.getTimeStamp();
-                    targetSequenceIndex = i;
+                    if (message.isNoteOff())
+                    {
+                        return true;
+                    }
+
+                    break;
                 }
             }
         }
 
-        if (targetSequenceIndex < 0)
+        return false;
+    }
+
+private:
+    
+    // Returns the index of the first event at or after the timestamp;
+    // the search starts from the sequence's current position, and gallops
+    // towards the target with doubling steps, then bisects the last step,
+    // so the seeks cost O(log distance): loop rewinds of short regions
+    // stay cheap even in huge projects, and any other seek is O(log events)
+    static int getNextIndexAtTime(const MidiMessageSequence &sequence,
+        int startIndex, double timeStamp) noexcept
+    {
+        const auto numEvents = sequence.getNumEvents();
+        const auto getTimeStamp = [&sequence](int index)
         {
-            return false;
+            return sequence.getEventPointer(index)->message.getTimeStamp();
+        };
+
+        // the result is always within (low, high]:
+        // low is either -1 or an event before the timestamp,
+        // high is either numEvents or an event at or after it
+        int low = -1;
+        int high = numEvents;
+
+        const auto cursor = jlimit(0, numEvents, startIndex);
+        if (cursor < numEvents && getTimeStamp(cursor) < timeStamp)
+        {
+            low = cursor;
+            for (int step = 1; low + step < numEvents; step *= 2)
+            {
+                if (getTimeStamp(low + step) >= timeStamp)
+                {
+                    high = low + step;
+                    break;
+                }
+
+                low += step;
+            }
+        }
+        else
+        {
+            high = cursor;
+            for (int step = 1; high - step >= 0; step *= 2)
+            {
+                if (getTimeStamp(high - step) < timeStamp)
+                {
+                    low = high - step;
+                    break;
+                }
+
+                high -= step;
+            }
+        }
+
+        while (high - low > 1)
+        {
+            const auto middle = low + (high - low) / 2;
+            if (getTimeStamp(middle) < timeStamp)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
         }
 
-        auto *foundWrapper = this->sequences.getObjectPointer(targetSequenceIndex);
-        jassert(foundWrapper->currentIndex < foundWrapper->midiMessages.getNumEvents());
+        return high;
+    }
 
-        auto &foundMessage = foundWrapper->midiMessages.getEventPointer(foundWrapper->currentIndex)->message;
-        foundWrapper->currentIndex++;
+    void rebuildMergeHeap()
+    {
+        const CriticalSection::ScopedLockType lock(this->sequences.getLock());
 
-        target.message = foundMessage;
-        target.listener = foundWrapper->listener;
-        target.instrument = foundWrapper->instrument;
+        this->mergeHeap.clear();
+        this->mergeHeap.reserve(this->sequences.size());
 
-        return true;
+        for (int i = 0; i < this->sequences.size(); ++i)
+        {
+            const auto *wrapper = this->sequences.getObjectPointerUnchecked(i);
+            const auto currentIndex = this->currentIndices[i];
+            if (currentIndex < wrapper->midiMessages.getNumEvents())
+            {
+                const auto &message = wrapper->midiMessages.getEventPointer(currentIndex)->message;
+                this->mergeHeap.push_back({ message.getTimeStamp(), i, wrapper });
+            }
+        }
+
+        for (int i = int(this->mergeHeap.size()) / 2 - 1; i >= 0; --i)
+        {
+            this->siftDown(i);
+        }
+
+        this->mergeHeapIsOutdated = false;
     }
-    
-private:
-    
-    int getNextIndexAtTime(const MidiMessageSequence &sequence, double timeStamp) const
+
+    void siftDown(int index) noexcept
     {
-        int i = 0;
-        for (; i < sequence.getNumEvents(); ++i)
+        const auto size = int(this->mergeHeap.size());
+        if (index >= size)
+        {
+            return;
+        }
+
+        const auto entry = this->mergeHeap[index];
+
+        while (true)
         {
-            const double eventTs = sequence.getEventPointer(i)->message.getTimeStamp();
-            if (eventTs >= timeStamp)
+            auto child = index * 2 + 1;
+            if (child >= size)
             {
                 break;
             }
+
+            if (child + 1 < size && this->mergeHeap[child + 1].isBefore(this->mergeHeap[child]))
+            {
+                child++;
+            }
+
+            if (!this->mergeHeap[child].isBefore(entry))
+            {
+                break;
+            }
+
+            this->mergeHeap[index] = this->mergeHeap[child];
+            index = child;
         }
-        
-        return i;
+
+        this->mergeHeap[index] = entry;
     }
 
     JUCE_LEAK_DETECTOR(TransportPlaybackCache)
@@ -68,8 +68,13 @@ namespace I18n
         static constexpr auto keySignatureEditCaption = constexprHash("dialog::keysignature::edit::caption");
         static constexpr auto renameTrackCaption = constexprHash("dialog::renametrack::caption");
         static constexpr auto renderAbort = constexprHash("dialog::render::abort");
+        static constexpr auto renderBitDepth = constexprHash("dialog::render::bitdepth");
+        static constexpr auto renderBlockSize = constexprHash("dialog::render::blocksize");
         static constexpr auto renderCaption = constexprHash("dialog::render::caption");
+        static constexpr auto renderDoublePrecision = constexprHash("dialog::render::doubleprecision");
+        static constexpr auto renderLoading = constexprHash("dialog::render::loading");
         static constexpr auto renderProceed = constexprHash("dialog::render::proceed");
+        static constexpr auto renderStems = constexprHash("dialog::render::stems");
         static constexpr auto scanFolderCaption = constexprHash("dialog::scanfolder::caption");
         static constexpr auto timeSignatureAddCaption = constexprHash("dialog::timesignature::add::caption");
         static constexpr auto timeSignatureEditCaption = constexprHash("dialog::timesignature::edit::caption");
@@ -162,8 +167,11 @@ namespace I18n
             static constexpr auto importMidi = constexprHash("menu::project::import::midi");
             static constexpr auto refactor = constexprHash("menu::project::refactor");
             static constexpr auto render = constexprHash("menu::project::render");
+            static constexpr auto renderAiff = constexprHash("menu::project::render::aiff");
             static constexpr auto renderFlac = constexprHash("menu::project::render::flac");
             static constexpr auto renderMidi = constexprHash("menu::project::render::midi");
+            static constexpr auto renderOgg = constexprHash("menu::project::render::ogg");
+            static constexpr auto renderRaw = constexprHash("menu::project::render::raw");
             static constexpr auto renderSavedTo = constexprHash("menu::project::render::savedto");
             static constexpr auto renderWav = constexprHash("menu::project::render::wav");
             static constexpr auto transposeDown = constexprHash("menu::project::transpose::down");
@@ -0,0 +1,158 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovAliasTables.h"
+
+void MarkovAliasTables::build(const std::vector<int> &rowOffsets,
+    const std::vector<int> &counts)
+{
+    this->probabilities.resize(counts.size());
+    this->aliases.resize(counts.size());
+
+    // the scratch buffers are shared by all rows;
+    // the weights are scaled by the row size and compared to the row total,
+    // so that the whole partitioning is done in exact integer arithmetic
+    std::vector<int64> scaled;
+    std::vector<int> small;
+    std::vector<int> large;
+
+    const auto numRows = int(rowOffsets.size()) - 1;
+    for (int r = 0; r < numRows; ++r)
+    {
+        const auto rowStart = rowOffsets[r];
+        const auto rowSize = rowOffsets[r + 1] - rowStart;
+        if (rowSize == 0)
+        {
+            continue;
+        }
+
+        int64 total = 0;
+        for (int i = 0; i < rowSize; ++i)
+        {
+            total += counts[rowStart + i];
+        }
+
+        scaled.resize(rowSize);
+        small.clear();
+        large.clear();
+
+        for (int i = 0; i < rowSize; ++i)
+        {
+            scaled[i] = int64(counts[rowStart + i]) * rowSize;
+            if (scaled[i] < total)
+            {
+                small.push_back(i);
+            }
+            else
+            {
+                large.push_back(i);
+            }
+        }
+
+        auto *rowProbabilities = this->probabilities.data() + rowStart;
+        auto *rowAliases = this->aliases.data() + rowStart;
+
+        while (!small.empty() && !large.empty())
+        {
+            const auto less = small.back();
+            small.pop_back();
+            const auto more = large.back();
+            large.pop_back();
+
+            rowProbabilities[less] = float(double(scaled[less]) / double(total));
+            rowAliases[less] = more;
+
+            scaled[more] -= (total - scaled[less]);
+            if (scaled[more] < total)
+            {
+                small.push_back(more);
+            }
+            else
+            {
+                large.push_back(more);
+            }
+        }
+
+        // whatever is left is full, up to the rounding errors
+        for (const auto i : large)
+        {
+            rowProbabilities[i] = 1.f;
+            rowAliases[i] = i;
+        }
+
+        for (const auto i : small)
+        {
+            rowProbabilities[i] = 1.f;
+            rowAliases[i] = i;
+        }
+    }
+}
+
+int MarkovAliasTables::sample(int rowStart, int rowSize, Random &random) const noexcept
+{
+    jassert(rowSize > 0);
+    const auto i = random.nextInt(rowSize);
+    return random.nextFloat() < this->probabilities[rowStart + i] ?
+        i : this->aliases[rowStart + i];
+}
+
+void MarkovAliasTables::clear() noexcept
+{
+    this->probabilities.clear();
+    this->aliases.clear();
+}
+
+void MarkovAliasTables::writeTo(MarkovBinaryFormat::Writer &writer) const
+{
+    writer.write(this->probabilities);
+    writer.write(this->aliases);
+}
+
+bool MarkovAliasTables::readFrom(MarkovBinaryFormat::Reader &reader,
+    const std::vector<int> &rowOffsets)
+{
+    const auto numItems = rowOffsets.empty() ? 0 : rowOffsets.back();
+
+    bool isValid = reader.read(this->probabilities) &&
+        reader.read(this->aliases) &&
+        this->probabilities.size() == size_t(numItems) &&
+        this->aliases.size() == size_t(numItems);
+
+    for (size_t r = 1; isValid && r < rowOffsets.size(); ++r)
+    {
+        const auto rowStart = rowOffsets[r - 1];
+        const auto rowSize = rowOffsets[r] - rowStart;
+
+        for (int i = rowStart; isValid && i < rowStart + rowSize; ++i)
+        {
+            // written this way, so that NaNs don't pass
+            const auto probability = this->probabilities[i];
+            isValid = probability >= 0.f && probability <= 1.f &&
+                this->aliases[i] >= 0 && this->aliases[i] < rowSize;
+        }
+    }
+
+    if (!isValid)
+    {
+        reader.fail();
+        this->clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,66 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovBinaryFormat.h"
+#include <vector>
+
+// Walker's alias method tables (Vose's variant) for sampling from many
+// discrete distributions at once, stored the same way as the rows of
+// a sparse matrix: each row takes a uniform pick of an item plus one
+// comparison, regardless of the number of items in the row.
+
+class MarkovAliasTables final
+{
+public:
+
+    MarkovAliasTables() = default;
+
+    // The rows layout is the same as in MarkovTransitionMatrix,
+    // counts may be zero, but each non-empty row must have a positive total
+    void build(const std::vector<int> &rowOffsets, const std::vector<int> &counts);
+    void clear() noexcept;
+
+    inline int getNumItems() const noexcept
+    {
+        return int(this->probabilities.size());
+    }
+
+    inline bool isEmpty() const noexcept
+    {
+        return this->probabilities.empty();
+    }
+
+    // Returns the row-local index of the picked item
+    int sample(int rowStart, int rowSize, Random &random) const noexcept;
+
+    // The tables are validated against the rows layout they were built for,
+    // so that the sampling never reads out of the row, whatever the input
+    void writeTo(MarkovBinaryFormat::Writer &writer) const;
+    bool readFrom(MarkovBinaryFormat::Reader &reader, const std::vector<int> &rowOffsets);
+
+private:
+
+    // Thresholds of keeping the picked item
+    std::vector<float> probabilities;
+
+    // Row-local indices of the items to use otherwise
+    std::vector<int> aliases;
+
+    JUCE_LEAK_DETECTOR(MarkovAliasTables)
+};
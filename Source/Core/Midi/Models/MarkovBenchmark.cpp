@@ -0,0 +1,271 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovBenchmark.h"
+#include "MarkovCorpusTrainer.h"
+#include "MarkovGenerator.h"
+#include "SerializationKeys.h"
+
+#if JUCE_LINUX
+#   include <fcntl.h>
+#   include <unistd.h>
+#   if defined (__GLIBC__)
+#       include <malloc.h>
+#   endif
+#endif
+
+static const int kSyntheticSizes[] = { 1000, 10000, 100000, 1000000 };
+static const int kChordDensities[] = { 1, 2, 4 };
+static const int kOrders[] = { 1, 3 };
+
+static constexpr auto kNumSamples = 1000000;
+static constexpr int64 kSeed = 0x4d61726b6f76;
+
+// the smaller cases are repeated, and the best time is taken
+static int getNumRuns(int numNotes)
+{
+    return jlimit(1, 10, 100000 / numNotes);
+}
+
+#if JUCE_LINUX
+
+// Reads one of the "VmXXX:    1234 kB" lines of the process status
+static double readProcessStatusMb(const String &field)
+{
+    StringArray lines;
+    File("/proc/self/status").readLines(lines);
+    for (const auto &line : lines)
+    {
+        if (line.startsWith(field))
+        {
+            return line.fromFirstOccurrenceOf(":", false, false).getDoubleValue() / 1024.0;
+        }
+    }
+
+    return -1.0;
+}
+
+#endif
+
+// Each case's peak memory is measured on its own: the resident set size
+// high-water mark is reset before the case, and the freed memory of the
+// previous cases is given back to the system, so that it isn't reused
+// unnoticed; returns the resident set size at the start, -1 if unsupported
+static double startMeasuringPeakMemory()
+{
+#if JUCE_LINUX
+#   if defined (__GLIBC__)
+    malloc_trim(0);
+#   endif
+
+    const auto handle = open("/proc/self/clear_refs", O_WRONLY);
+    if (handle < 0)
+    {
+        return -1.0;
+    }
+
+    const auto numWritten = write(handle, "5", 1);
+    close(handle);
+    return numWritten == 1 ? readProcessStatusMb("VmRSS:") : -1.0;
+#else
+    return -1.0;
+#endif
+}
+
+// How much the resident set size has grown at its peak
+// since startMeasuringPeakMemory, or -1 if unsupported
+static double getPeakMemoryGrowthMb(double startMb)
+{
+#if JUCE_LINUX
+    const auto peakMb = startMb < 0.0 ? -1.0 : readProcessStatusMb("VmHWM:");
+    return peakMb < 0.0 ? -1.0 : jmax(0.0, peakMb - startMb);
+#else
+    ignoreUnused(startMb);
+    return -1.0;
+#endif
+}
+
+SerializedData MarkovBenchmark::run(const File &fixturesDirectory) const
+{
+    using namespace Serialization::Midi::Markov;
+    SerializedData results(Benchmark::results);
+
+    for (const auto numNotes : kSyntheticSizes)
+    {
+        for (const auto chordDensity : kChordDensities)
+        {
+            for (const auto order : kOrders)
+            {
+                results.appendChild(this->runSyntheticCase(numNotes, chordDensity, order));
+            }
+        }
+    }
+
+    if (fixturesDirectory.isDirectory())
+    {
+        const auto files = MarkovCorpusTrainer::findMidiFiles(fixturesDirectory);
+        if (!files.isEmpty())
+        {
+            for (const auto order : kOrders)
+            {
+                results.appendChild(this->runCorpusCase(files, order));
+            }
+        }
+    }
+
+    return results;
+}
+
+Array<Note> MarkovBenchmark::makeSyntheticSequence(int numNotes, int chordDensity, int64 seed)
+{
+    Random random(seed);
+
+    Array<Note> notes;
+    notes.ensureStorageAllocated(numNotes);
+
+    // a random walk over the scale degrees, with chords stacked in thirds,
+    // so that the number of distinct sound objects grows like in real music,
+    // i.e. much slower than the sequence length
+    static const int kMajorScale[] = { 0, 2, 4, 5, 7, 9, 11 };
+    static const float kLengths[] = { 0.25f, 0.5f, 0.5f, 1.f, 1.f, 2.f };
+
+    int degree = 14;
+    float beat = 0.f;
+
+    while (notes.size() < numNotes)
+    {
+        degree = jlimit(0, 27, degree + random.nextInt(5) - 2);
+
+        const auto length = kLengths[random.nextInt(numElementsInArray(kLengths))];
+        const auto chordSize = jmin(numNotes - notes.size(),
+            1 + random.nextInt(2 * chordDensity - 1));
+
+        for (int i = 0; i < chordSize; ++i)
+        {
+            const auto chordDegree = degree + i * 2;
+            const auto key = 36 + (chordDegree / 7) * 12 + kMajorScale[chordDegree % 7];
+            const auto velocity = 0.5f + random.nextFloat() * 0.25f;
+            notes.add(Note(nullptr, key, beat, length, velocity));
+        }
+
+        beat += length;
+    }
+
+    return notes;
+}
+
+SerializedData MarkovBenchmark::runSyntheticCase(int numNotes, int chordDensity, int order) const
+{
+    using namespace Serialization::Midi::Markov;
+
+    const auto startMemoryMb = startMeasuringPeakMemory();
+    const auto notes = MarkovBenchmark::makeSyntheticSequence(numNotes, chordDensity, kSeed);
+
+    MarkovModel model;
+
+    Timings bestTimings;
+    bestTimings.buildMs = std::numeric_limits<double>::max();
+    bestTimings.normaliseMs = std::numeric_limits<double>::max();
+    bestTimings.samplingTablesMs = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < getNumRuns(numNotes); ++i)
+    {
+        const auto startTime = Time::getMillisecondCounterHiRes();
+        model.generateFromSequence(notes, order);
+
+        Timings timings;
+        timings.buildMs = Time::getMillisecondCounterHiRes() - startTime;
+        MarkovBenchmark::measureSampling(model, timings);
+
+        bestTimings.buildMs = jmin(bestTimings.buildMs, timings.buildMs);
+        bestTimings.normaliseMs = jmin(bestTimings.normaliseMs, timings.normaliseMs);
+        bestTimings.samplingTablesMs = jmin(bestTimings.samplingTablesMs, timings.samplingTablesMs);
+        bestTimings.samplesPerSecond = jmax(bestTimings.samplesPerSecond, timings.samplesPerSecond);
+    }
+
+    bestTimings.peakMemoryMb = getPeakMemoryGrowthMb(startMemoryMb);
+
+    SerializedData tree(Benchmark::testCase);
+    tree.setProperty(Benchmark::name, "synthetic");
+    tree.setProperty(Benchmark::numNotes, numNotes);
+    tree.setProperty(Benchmark::chordDensity, chordDensity);
+    MarkovBenchmark::addResults(tree, model, bestTimings);
+
+    return tree;
+}
+
+SerializedData MarkovBenchmark::runCorpusCase(const Array<File> &files, int order) const
+{
+    using namespace Serialization::Midi::Markov;
+
+    const auto startMemoryMb = startMeasuringPeakMemory();
+
+    MarkovModel model;
+    Timings timings;
+
+    // this one includes the files import, and is not repeated
+    const auto startTime = Time::getMillisecondCounterHiRes();
+    const MarkovCorpusTrainer trainer(order);
+    const auto numFiles = trainer.train(files, model);
+    timings.buildMs = Time::getMillisecondCounterHiRes() - startTime;
+
+    MarkovBenchmark::measureSampling(model, timings);
+    timings.peakMemoryMb = getPeakMemoryGrowthMb(startMemoryMb);
+
+    SerializedData tree(Benchmark::testCase);
+    tree.setProperty(Benchmark::name, "corpus");
+    tree.setProperty(Benchmark::numFiles, numFiles);
+    tree.setProperty(Benchmark::numNotes, int(model.getSequence().size()));
+    MarkovBenchmark::addResults(tree, model, timings);
+    return tree;
+}
+
+void MarkovBenchmark::measureSampling(const MarkovModel &model, Timings &timings)
+{
+    // the first access after training rebuilds the matrix,
+    // the initial distribution, and the contexts, if any
+    auto startTime = Time::getMillisecondCounterHiRes();
+    model.getTransitionMatrix();
+    timings.normaliseMs = Time::getMillisecondCounterHiRes() - startTime;
+
+    startTime = Time::getMillisecondCounterHiRes();
+    model.getTransitionSamplingTables();
+    timings.samplingTablesMs = Time::getMillisecondCounterHiRes() - startTime;
+
+    const MarkovGenerator generator(model);
+
+    startTime = Time::getMillisecondCounterHiRes();
+    const auto numGenerated = generator.generate(kNumSamples, kSeed).size();
+    const auto samplingMs = Time::getMillisecondCounterHiRes() - startTime;
+    timings.samplesPerSecond = samplingMs > 0.0 ? double(numGenerated) * 1000.0 / samplingMs : 0.0;
+}
+
+void MarkovBenchmark::addResults(SerializedData &tree,
+    const MarkovModel &model, const Timings &timings)
+{
+    using namespace Serialization::Midi::Markov;
+
+    tree.setProperty(Benchmark::order, model.getOrder());
+    tree.setProperty(Benchmark::numStates, model.Size());
+    tree.setProperty(Benchmark::numTransitions, model.getSamplingMatrix().getNumTransitions());
+    tree.setProperty(Benchmark::buildMs, timings.buildMs);
+    tree.setProperty(Benchmark::normaliseMs, timings.normaliseMs);
+    tree.setProperty(Benchmark::samplingTablesMs, timings.samplingTablesMs);
+    tree.setProperty(Benchmark::samplesPerSecond, timings.samplesPerSecond);
+    tree.setProperty(Benchmark::peakMemoryMb, timings.peakMemoryMb);
+}
@@ -0,0 +1,65 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovModel.h"
+
+// Measures the costs of the Markov engine: building the model from notes,
+// normalising the counts into the sampling distributions, building the alias
+// tables, and the sampling throughput, plus how much memory each case takes
+// at its peak (only measured on Linux, it's -1 elsewhere).
+//
+// The synthetic sequences are generated from a fixed seed, so the results
+// of different builds are comparable; a folder of midi files can be added
+// as a real-world corpus. The results are returned as a tree, which the
+// headless runner saves as json, see App::benchmarkMarkovModels.
+
+class MarkovBenchmark final
+{
+public:
+
+    MarkovBenchmark() = default;
+
+    // The fixtures directory is optional, i.e. it is skipped if it doesn't exist
+    SerializedData run(const File &fixturesDirectory) const;
+
+private:
+
+    struct Timings final
+    {
+        double buildMs = 0.0;
+        double normaliseMs = 0.0;
+        double samplingTablesMs = 0.0;
+        double samplesPerSecond = 0.0;
+        double peakMemoryMb = -1.0;
+    };
+
+    // The chord density is the average number of notes in a sound object
+    static Array<Note> makeSyntheticSequence(int numNotes, int chordDensity, int64 seed);
+
+    SerializedData runSyntheticCase(int numNotes, int chordDensity, int order) const;
+    SerializedData runCorpusCase(const Array<File> &files, int order) const;
+
+    // Builds the derived data and samples from an already trained model
+    static void measureSampling(const MarkovModel &model, Timings &timings);
+
+    static void addResults(SerializedData &tree,
+        const MarkovModel &model, const Timings &timings);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MarkovBenchmark)
+};
@@ -0,0 +1,144 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <type_traits>
+
+// The building blocks of the trained Markov models' binary format:
+// all the model's tables are flat arrays of plain numbers, which are written
+// as is, in the little-endian byte order, each prefixed with its length,
+// and each padded to 8 bytes, so that every array in the file is aligned;
+// this way, reading a model back is a sequence of bulk copies from
+// a memory-mapped file, with no parsing and no per-item conversions.
+
+namespace MarkovBinaryFormat
+{
+    static constexpr int alignment = 8;
+
+    class Writer final
+    {
+    public:
+
+        explicit Writer(OutputStream &stream) noexcept : stream(stream) {}
+
+        template <typename T>
+        void write(T value)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only plain numbers are supported");
+            this->writeRaw(&value, sizeof(T));
+        }
+
+        template <typename T>
+        void write(const std::vector<T> &array)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only plain numbers are supported");
+            this->write(uint64(array.size()));
+            this->writeRaw(array.data(), array.size() * sizeof(T));
+        }
+
+    private:
+
+        void writeRaw(const void *data, size_t numBytes)
+        {
+            static const char padding[alignment] = {};
+
+            this->stream.write(data, numBytes);
+            const auto remainder = numBytes % alignment;
+            if (remainder != 0)
+            {
+                this->stream.write(padding, alignment - remainder);
+            }
+        }
+
+        OutputStream &stream;
+
+        JUCE_DECLARE_NON_COPYABLE(Writer)
+    };
+
+    class Reader final
+    {
+    public:
+
+        Reader(const void *data, size_t size) noexcept :
+            data(static_cast<const uint8 *>(data)), size(size) {}
+
+        template <typename T>
+        bool read(T &outValue) noexcept
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only plain numbers are supported");
+            return this->readRaw(&outValue, sizeof(T));
+        }
+
+        // Limits the array size to protect from allocating
+        // unreasonable amounts of memory when reading a corrupted file
+        template <typename T>
+        bool read(std::vector<T> &outArray)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only plain numbers are supported");
+
+            uint64 numItems = 0;
+            if (!this->read(numItems) ||
+                numItems > (this->size - this->position) / sizeof(T))
+            {
+                this->failed = true;
+                return false;
+            }
+
+            outArray.resize(size_t(numItems));
+            return this->readRaw(outArray.data(), size_t(numItems) * sizeof(T));
+        }
+
+        bool hasFailed() const noexcept
+        {
+            return this->failed;
+        }
+
+        void fail() noexcept
+        {
+            this->failed = true;
+        }
+
+    private:
+
+        bool readRaw(void *destination, size_t numBytes) noexcept
+        {
+            const auto paddedSize = (numBytes + alignment - 1) / alignment * alignment;
+            if (this->failed || paddedSize > this->size - this->position)
+            {
+                this->failed = true;
+                return false;
+            }
+
+            if (numBytes > 0)
+            {
+                memcpy(destination, this->data + this->position, numBytes);
+            }
+
+            this->position += paddedSize;
+            return true;
+        }
+
+        const uint8 *data = nullptr;
+        size_t size = 0;
+        size_t position = 0;
+        bool failed = false;
+
+        JUCE_DECLARE_NON_COPYABLE(Reader)
+    };
+}
@@ -0,0 +1,196 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovContextTrie.h"
+
+void MarkovContextTrie::build(const std::vector<StateId> &sequence,
+    const std::vector<int> &sequenceBreaks, int numStates, int order)
+{
+    this->clear();
+
+    jassert(order > 0 && order <= MarkovContextTrie::maxOrder);
+    this->order = jlimit(1, MarkovContextTrie::maxOrder, order);
+
+    if (sequence.empty() || numStates <= 0)
+    {
+        return;
+    }
+
+    // the root, i.e. the empty context
+    this->nodeDepths.push_back(0);
+
+    // {node, next state} -> count
+    FlatHashMap<uint64, int> counts;
+    counts.reserve(sequence.size() * 2);
+
+    size_t pieceStart = 0;
+    auto nextBreak = sequenceBreaks.begin();
+
+    for (size_t i = 0; i < sequence.size(); ++i)
+    {
+        const auto next = sequence[i];
+        jassert(int(next) < numStates);
+
+        while (nextBreak != sequenceBreaks.end() && size_t(*nextBreak) <= i)
+        {
+            pieceStart = size_t(*nextBreak);
+            ++nextBreak;
+        }
+
+        auto node = MarkovContextTrie::rootNode;
+        counts[packEdge(node, next)] += 1;
+
+        // walk back through the history, adding the missing contexts
+        const auto maxDepth = jmin(size_t(this->order), i - pieceStart);
+        for (size_t depth = 1; depth <= maxDepth; ++depth)
+        {
+            const auto edge = packEdge(node, sequence[i - depth]);
+            const auto found = this->children.find(edge);
+            if (found != this->children.end())
+            {
+                node = found->second;
+            }
+            else
+            {
+                const auto newNode = NodeId(this->nodeDepths.size());
+                this->nodeDepths.push_back(int8(depth));
+                this->children.emplace(edge, newNode);
+                node = newNode;
+            }
+
+            counts[packEdge(node, next)] += 1;
+        }
+    }
+
+    std::vector<MarkovTransitionMatrix::Transition> transitions;
+    transitions.reserve(counts.size());
+
+    for (const auto &it : counts)
+    {
+        const auto node = MarkovTransitionMatrix::StateId(it.first >> 32);
+        const auto next = MarkovTransitionMatrix::StateId(it.first & 0xffffffff);
+        transitions.push_back({ node, next, it.second });
+    }
+
+    this->continuations.build(this->getNumNodes(), numStates, transitions);
+}
+
+void MarkovContextTrie::clear() noexcept
+{
+    this->order = 0;
+    this->children.clear();
+    this->nodeDepths.clear();
+    this->continuations.clear();
+}
+
+MarkovContextTrie::NodeId MarkovContextTrie::findContext(const StateId *history, int historySize) const
+{
+    auto node = MarkovContextTrie::rootNode;
+    const auto maxDepth = jmin(this->order, historySize);
+
+    // each node in the trie has at least one continuation,
+    // so the deepest match is always the one to use
+    for (int depth = 1; depth <= maxDepth; ++depth)
+    {
+        const auto found = this->children.find(packEdge(node, history[historySize - depth]));
+        if (found == this->children.end())
+        {
+            break;
+        }
+
+        node = found->second;
+    }
+
+    return node;
+}
+
+MarkovTransitionMatrix::StateId MarkovContextTrie::sample(const StateId *history,
+    int historySize, float random) const
+{
+    if (this->isEmpty())
+    {
+        return -1;
+    }
+
+    const auto node = this->findContext(history, historySize);
+    return this->continuations.sample(node, random);
+}
+
+void MarkovContextTrie::writeTo(MarkovBinaryFormat::Writer &writer) const
+{
+    // the children table is written as the list of incoming edges,
+    // indexed by node id, the root having none
+    std::vector<int32> parents(this->nodeDepths.size(), -1);
+    std::vector<uint32> states(this->nodeDepths.size(), 0);
+
+    for (const auto &it : this->children)
+    {
+        parents[it.second] = int32(it.first >> 32);
+        states[it.second] = uint32(it.first & 0xffffffff);
+    }
+
+    writer.write(int32(this->order));
+    writer.write(this->nodeDepths);
+    writer.write(parents);
+    writer.write(states);
+    this->continuations.writeTo(writer);
+}
+
+bool MarkovContextTrie::readFrom(MarkovBinaryFormat::Reader &reader, int numStates)
+{
+    this->clear();
+
+    int32 newOrder = 0;
+    std::vector<int32> parents;
+    std::vector<uint32> states;
+
+    if (!reader.read(newOrder) ||
+        !reader.read(this->nodeDepths) ||
+        !reader.read(parents) ||
+        !reader.read(states) ||
+        !this->continuations.readFrom(reader, numStates) ||
+        newOrder < 0 || newOrder > MarkovContextTrie::maxOrder ||
+        parents.size() != this->nodeDepths.size() ||
+        states.size() != this->nodeDepths.size() ||
+        (!this->nodeDepths.empty() && this->nodeDepths.front() != 0) ||
+        this->continuations.getNumStates() != this->getNumNodes())
+    {
+        reader.fail();
+        this->clear();
+        return false;
+    }
+
+    this->order = newOrder;
+    this->children.reserve(this->nodeDepths.size());
+
+    for (NodeId node = 1; node < this->getNumNodes(); ++node)
+    {
+        const auto parent = parents[node];
+        if (parent < 0 || parent >= node || int(states[node]) >= numStates ||
+            this->nodeDepths[node] != this->nodeDepths[parent] + 1)
+        {
+            reader.fail();
+            this->clear();
+            return false;
+        }
+
+        this->children.emplace(packEdge(parent, states[node]), node);
+    }
+
+    return true;
+}
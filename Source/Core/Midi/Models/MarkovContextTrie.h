@@ -0,0 +1,112 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovTransitionMatrix.h"
+#include <vector>
+
+// The contexts of the higher-order Markov chain, stored as a trie of
+// reversed histories: the root is the empty context, its children are
+// the contexts of length 1 (the previous state), their children prepend
+// the state before that, and so on, up to the model's order.
+//
+// Only the contexts which actually occur in the source sequence get a node,
+// so the memory grows with the sequence length times the order, and not
+// with the number of states to the power of the order. Each node's
+// continuations are kept in one shared sparse matrix, rows being the nodes.
+//
+// The sampling backs off to the longest known suffix of the history,
+// down to the root, which holds the plain frequencies of all states.
+
+class MarkovContextTrie final
+{
+public:
+
+    using StateId = uint32;
+    using NodeId = int;
+
+    static constexpr int maxOrder = 8;
+    static constexpr NodeId rootNode = 0;
+
+    MarkovContextTrie() = default;
+
+    // The breaks are the sorted indices where the independent pieces of
+    // the sequence start, e.g. the tracks of a corpus, no context spans them
+    void build(const std::vector<StateId> &sequence,
+        const std::vector<int> &sequenceBreaks, int numStates, int order);
+    void clear() noexcept;
+
+    inline int getOrder() const noexcept
+    {
+        return this->order;
+    }
+
+    inline int getNumNodes() const noexcept
+    {
+        return int(this->nodeDepths.size());
+    }
+
+    inline int getNodeDepth(NodeId node) const noexcept
+    {
+        jassert(node >= 0 && node < this->getNumNodes());
+        return this->nodeDepths[node];
+    }
+
+    inline bool isEmpty() const noexcept
+    {
+        return this->continuations.isEmpty();
+    }
+
+    // Returns the node of the longest known context, which is a suffix
+    // of the given history (the last item being the most recent state);
+    // if nothing matches, returns the root node
+    NodeId findContext(const StateId *history, int historySize) const;
+
+    // The continuations of each context node, columns are the state ids
+    inline const MarkovTransitionMatrix &getContinuations() const noexcept
+    {
+        return this->continuations;
+    }
+
+    // Picks the next state for the given history and a random value in [0 .. 1),
+    // returns -1 if the trie is empty
+    MarkovTransitionMatrix::StateId sample(const StateId *history,
+        int historySize, float random) const;
+
+    void writeTo(MarkovBinaryFormat::Writer &writer) const;
+    bool readFrom(MarkovBinaryFormat::Reader &reader, int numStates);
+
+private:
+
+    static inline uint64 packEdge(NodeId node, StateId state) noexcept
+    {
+        return (uint64(node) << 32) | uint64(state);
+    }
+
+    int order = 0;
+
+    // {parent node, state} -> child node
+    FlatHashMap<uint64, NodeId> children;
+
+    // indexed by node id, the length of the context
+    std::vector<int8> nodeDepths;
+
+    MarkovTransitionMatrix continuations;
+
+    JUCE_LEAK_DETECTOR(MarkovContextTrie)
+};
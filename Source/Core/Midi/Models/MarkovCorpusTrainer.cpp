@@ -0,0 +1,299 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovCorpusTrainer.h"
+#include "PianoSequence.h"
+
+// more batches than threads, so that the threads stay busy
+// even when some files are much larger than the others
+static constexpr auto kBatchesPerThread = 4;
+
+class MarkovTrainerThread final : public Thread
+{
+public:
+
+    explicit MarkovTrainerThread(Function<void()> job) :
+        Thread("Markov trainer"),
+        job(move(job)) {}
+
+    void run() override
+    {
+        this->job();
+    }
+
+private:
+
+    const Function<void()> job;
+
+    JUCE_DECLARE_NON_COPYABLE(MarkovTrainerThread)
+};
+
+MarkovCorpusTrainer::MarkovCorpusTrainer(int order, int numThreads) :
+    order(jlimit(1, MarkovModel::maxOrder, order)),
+    numThreads(numThreads > 0 ? numThreads : jmax(1, SystemStats::getNumCpus())) {}
+
+int MarkovCorpusTrainer::train(const Array<File> &files, MarkovModel &outModel) const
+{
+    outModel.clear();
+    outModel.order = this->order;
+
+    if (files.isEmpty())
+    {
+        return 0;
+    }
+
+    const auto numBatches = jmin(files.size(), this->numThreads * kBatchesPerThread);
+    std::vector<Batch> batches(numBatches);
+
+    // the batches are contiguous ranges of files, so that
+    // merging them in order is the same as reading the files in order
+    this->runInParallel(numBatches, [&](int batchIndex)
+    {
+        auto &batch = batches[batchIndex];
+        const auto firstFile = int(int64(files.size()) * batchIndex / numBatches);
+        const auto lastFile = int(int64(files.size()) * (batchIndex + 1) / numBatches);
+        for (int i = firstFile; i < lastFile; ++i)
+        {
+            if (MarkovCorpusTrainer::importFile(files.getReference(i), batch))
+            {
+                batch.numFiles++;
+            }
+        }
+
+        batch.mergedIds.resize(batch.states.size());
+        for (size_t i = 0; i < batch.mergedIds.size(); ++i)
+        {
+            batch.mergedIds[i] = StateId(i);
+        }
+    });
+
+    // the parallel reduction: at each level, every batch with an even index
+    // (in the level's terms) takes in the tables of its odd neighbour,
+    // which already holds the tables of stride batches, and the merges
+    // within a level are independent of each other
+    for (int stride = 1; stride < numBatches; stride *= 2)
+    {
+        const auto numMerges = (numBatches - stride + 2 * stride - 1) / (2 * stride);
+        this->runInParallel(numMerges, [&](int mergeIndex)
+        {
+            const auto targetIndex = mergeIndex * 2 * stride;
+            const auto sourceIndex = targetIndex + stride;
+            const auto remap = MarkovCorpusTrainer::merge(batches[targetIndex], batches[sourceIndex]);
+
+            const auto lastMergedIndex = jmin(sourceIndex + stride, numBatches);
+            for (int i = sourceIndex; i < lastMergedIndex; ++i)
+            {
+                for (auto &id : batches[i].mergedIds)
+                {
+                    id = remap[id];
+                }
+            }
+        });
+    }
+
+    // now all batches' merged ids point into the first batch's dictionary,
+    // so the sequences can be remapped and copied in place, in parallel
+    std::vector<size_t> sequenceOffsets(numBatches + 1, 0);
+    for (int i = 0; i < numBatches; ++i)
+    {
+        sequenceOffsets[i + 1] = sequenceOffsets[i] + batches[i].sequence.size();
+        for (const auto sequenceBreak : batches[i].sequenceBreaks)
+        {
+            outModel.sequenceBreaks.push_back(int(sequenceOffsets[i]) + sequenceBreak);
+        }
+    }
+
+    outModel.sequence.resize(sequenceOffsets.back());
+    this->runInParallel(numBatches, [&](int batchIndex)
+    {
+        const auto &batch = batches[batchIndex];
+        auto *destination = outModel.sequence.data() + sequenceOffsets[batchIndex];
+        for (const auto state : batch.sequence)
+        {
+            *destination++ = batch.mergedIds[state];
+        }
+    });
+
+    auto &result = batches.front();
+
+    outModel.states = move(result.states);
+    outModel.soundFrequency = move(result.soundFrequency);
+    outModel.transitionFrequency = move(result.transitionFrequency);
+    outModel.matrixIsOutdated = true;
+
+    return result.numFiles;
+}
+
+Array<File> MarkovCorpusTrainer::findMidiFiles(const File &directory)
+{
+    auto files = directory.findChildFiles(File::findFiles, true, "*.mid;*.midi;*.smf");
+
+    // the order of the files defines the state ids,
+    // so it should not depend on the file system
+    files.sort();
+    return files;
+}
+
+//===----------------------------------------------------------------------===//
+// Workers
+//===----------------------------------------------------------------------===//
+
+bool MarkovCorpusTrainer::importFile(const File &file, Batch &batch)
+{
+    FileInputStream stream(file);
+    MidiFile midiFile;
+    if (!stream.openedOk() || !midiFile.readFrom(stream))
+    {
+        DBG("Skipping " + file.getFullPathName());
+        return false;
+    }
+
+    const auto timeFormat = midiFile.getTimeFormat();
+
+    Array<Note> notes;
+    FlatHashSet<int> pianoChannels;
+
+    for (int i = 0; i < midiFile.getNumTracks(); ++i)
+    {
+        const auto *track = midiFile.getTrack(i);
+
+        // split each track by channel, same as ProjectNode::importMidi does
+        pianoChannels.clear();
+        for (int j = 0; j < track->getNumEvents(); ++j)
+        {
+            const auto &message = track->getEventPointer(j)->message;
+            if (message.isNoteOnOrOff())
+            {
+                pianoChannels.insert(jlimit(1, Globals::numChannels, message.getChannel()));
+            }
+        }
+
+        for (const auto channel : pianoChannels)
+        {
+            notes.clearQuick();
+            const auto isSingleChannelTrack = pianoChannels.size() == 1;
+            PianoSequence::readMidiNotes(nullptr, *track, timeFormat,
+                isSingleChannelTrack ? Optional<int>() : channel, notes);
+
+            static Note comparator;
+            notes.sort(comparator);
+            MarkovCorpusTrainer::addPiece(notes, batch);
+        }
+    }
+
+    return true;
+}
+
+void MarkovCorpusTrainer::addPiece(const Array<Note> &sortedNotes, Batch &batch)
+{
+    if (sortedNotes.isEmpty())
+    {
+        return;
+    }
+
+    batch.sequenceBreaks.push_back(int(batch.sequence.size()));
+
+    std::vector<Note> chord;
+    auto previousState = MarkovStatesDictionary::invalidId;
+
+    int i = 0;
+    while (i < sortedNotes.size())
+    {
+        MarkovModel::getAllNotesFromBeat(sortedNotes, i, chord);
+        const auto state = batch.states.intern(chord);
+
+        if (state >= batch.soundFrequency.size())
+        {
+            batch.soundFrequency.resize(state + 1, 0);
+        }
+
+        batch.soundFrequency[state] += 1;
+
+        if (previousState != MarkovStatesDictionary::invalidId)
+        {
+            batch.transitionFrequency[MarkovModel::packTransition(previousState, state)] += 1;
+        }
+
+        batch.sequence.push_back(state);
+        previousState = state;
+    }
+}
+
+std::vector<MarkovCorpusTrainer::StateId> MarkovCorpusTrainer::merge(Batch &target, Batch &source)
+{
+    // the new states get their ids in the order of their first
+    // occurrence in the source, which keeps the ids deterministic
+    std::vector<StateId> remap(source.states.size());
+    for (int i = 0; i < source.states.size(); ++i)
+    {
+        remap[i] = target.states.intern(source.states.getSound(StateId(i)));
+    }
+
+    target.soundFrequency.resize(target.states.size(), 0);
+    for (size_t i = 0; i < source.soundFrequency.size(); ++i)
+    {
+        target.soundFrequency[remap[i]] += source.soundFrequency[i];
+    }
+
+    target.transitionFrequency.reserve(target.transitionFrequency.size() +
+        source.transitionFrequency.size());
+
+    for (const auto &it : source.transitionFrequency)
+    {
+        const auto from = remap[it.first >> 32];
+        const auto to = remap[it.first & 0xffffffff];
+        target.transitionFrequency[MarkovModel::packTransition(from, to)] += it.second;
+    }
+
+    target.numFiles += source.numFiles;
+
+    // the tables are not needed anymore
+    source.states.clear();
+    source.soundFrequency = {};
+    source.transitionFrequency = {};
+
+    return remap;
+}
+
+void MarkovCorpusTrainer::runInParallel(int numJobs,
+    const Function<void(int)> &job) const
+{
+    std::atomic<int> nextJob(0);
+    const auto runJobs = [&]()
+    {
+        for (int i = nextJob++; i < numJobs; i = nextJob++)
+        {
+            job(i);
+        }
+    };
+
+    OwnedArray<MarkovTrainerThread> threads;
+    const auto numHelperThreads = jmin(this->numThreads, numJobs) - 1;
+    for (int i = 0; i < numHelperThreads; ++i)
+    {
+        threads.add(new MarkovTrainerThread(runJobs))->startThread();
+    }
+
+    // the calling thread does its share of work too
+    runJobs();
+
+    for (auto *thread : threads)
+    {
+        thread->waitForThreadToExit(-1);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovModel.h"
+
+// Trains one Markov model on a corpus of midi files, e.g. to capture a style.
+//
+// The files are split into batches, and the batches are imported and
+// tokenized in worker threads, each one into its own dictionary and count
+// tables, with no locking; the partial tables are then merged pairwise,
+// in parallel, level by level, so the merging takes log2(batches) steps.
+//
+// The merge order follows the file order, so the resulting state ids and
+// the counts are exactly the same as if the files were read one by one,
+// no matter how many threads were used, and the generator's output
+// for a given seed is reproducible.
+//
+// No transitions or contexts are counted across the files' boundaries:
+// each track (and each channel in a multi-channel track) is a separate piece.
+
+class MarkovCorpusTrainer final
+{
+public:
+
+    // Zero threads means as many as there are cpu cores
+    explicit MarkovCorpusTrainer(int order = 1, int numThreads = 0);
+
+    // Returns the number of files which were successfully imported,
+    // the other ones are skipped; the model is cleared before training
+    int train(const Array<File> &files, MarkovModel &outModel) const;
+
+    // Finds all midi files in the directory and its subdirectories
+    static Array<File> findMidiFiles(const File &directory);
+
+private:
+
+    using StateId = MarkovModel::StateId;
+
+    // Everything collected from one batch of files; the tables are
+    // merged into the neighbour batches' ones, but the sequence is kept
+    // as is, with the local ids, and only remapped once, in the end
+    struct Batch final
+    {
+        MarkovStatesDictionary states;
+        std::vector<int> soundFrequency;
+        FlatHashMap<uint64, int> transitionFrequency;
+        int numFiles = 0;
+
+        std::vector<StateId> sequence;
+        std::vector<int> sequenceBreaks;
+
+        // local id -> id in the dictionary this batch was merged into
+        std::vector<StateId> mergedIds;
+    };
+
+    static bool importFile(const File &file, Batch &batch);
+    static void addPiece(const Array<Note> &sortedNotes, Batch &batch);
+
+    // Interns the source's states into the target's dictionary, adds up
+    // the counts and returns the source's ids remapped into the target's
+    static std::vector<StateId> merge(Batch &target, Batch &source);
+
+    // Runs the job for each index in [0 .. numJobs) on up to numThreads threads,
+    // returns when all jobs are done
+    void runInParallel(int numJobs, const Function<void(int)> &job) const;
+
+    const int order;
+    const int numThreads;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MarkovCorpusTrainer)
+};
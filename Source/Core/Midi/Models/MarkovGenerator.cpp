@@ -0,0 +1,72 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovGenerator.h"
+
+MarkovGenerator::MarkovGenerator(const MarkovModel &model) : model(model) {}
+
+std::vector<MarkovGenerator::StateId> MarkovGenerator::generate(int numSoundObjects, int64 seed) const
+{
+    std::vector<StateId> result;
+    if (numSoundObjects <= 0 || this->model.getSequence().empty())
+    {
+        return result;
+    }
+
+    result.reserve(numSoundObjects);
+
+    Random random(seed);
+    const auto &transitions = this->model.getSamplingMatrix();
+    const auto &tables = this->model.getTransitionSamplingTables();
+    const auto &rowOffsets = transitions.getRowOffsets();
+    const auto &columns = transitions.getColumns();
+    const auto &contexts = this->model.getContexts();
+    const bool usesContexts = this->model.getOrder() > 1 && !contexts.isEmpty();
+
+    result.push_back(this->sampleInitialState(random));
+
+    while (int(result.size()) < numSoundObjects)
+    {
+        // the output itself is the history for the context lookup
+        const auto row = usesContexts ?
+            contexts.findContext(result.data(), int(result.size())) :
+            int(result.back());
+
+        const auto rowStart = rowOffsets[row];
+        const auto rowSize = rowOffsets[row + 1] - rowStart;
+
+        if (rowSize == 0)
+        {
+            // a dead end of the first-order chain, e.g. the last sound
+            // object of the source sequence: start over from a random state
+            result.push_back(this->sampleInitialState(random));
+            continue;
+        }
+
+        const auto i = tables.sample(rowStart, rowSize, random);
+        result.push_back(StateId(columns[rowStart + i]));
+    }
+
+    return result;
+}
+
+MarkovGenerator::StateId MarkovGenerator::sampleInitialState(Random &random) const
+{
+    const auto &tables = this->model.getInitialSamplingTables();
+    return StateId(tables.sample(0, tables.getNumItems(), random));
+}
@@ -0,0 +1,51 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovModel.h"
+
+// Generates sequences of states from a trained model.
+//
+// Sampling uses Walker's alias method: the tables are precomputed once
+// per model (or loaded along with it), so that each step takes a uniform
+// pick of a column plus one comparison, regardless of how many
+// continuations the current state or context has.
+//
+// The generator keeps a reference to the model and doesn't own anything,
+// so the model must outlive it and must not change while generating.
+
+class MarkovGenerator final
+{
+public:
+
+    using StateId = MarkovModel::StateId;
+
+    explicit MarkovGenerator(const MarkovModel &model);
+
+    // The same seed always gives the same output for the same model;
+    // the result is empty if the model is empty
+    std::vector<StateId> generate(int numSoundObjects, int64 seed) const;
+
+private:
+
+    const MarkovModel &model;
+
+    StateId sampleInitialState(Random &random) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MarkovGenerator)
+};
@@ -1,158 +1,896 @@
 #include "MarkovModel.h"
+#include "MidiSequence.h"
+#include "MidiTrack.h"
+#include "SerializationKeys.h"
 
+static const char *kMarkovHeaderString = "HelioMkv";
+static const uint64 kMarkovHeader = ByteOrder::littleEndianInt64(kMarkovHeaderString);
+static const uint32 kMarkovFormatVersion = 2;
 
-MarkovModel::MarkovModel() :
-    StateMatrix(nullptr), InitialStateVector(nullptr)
+// format flags
+static const uint32 kHasSamplingTables = 1 << 0;
+
+MarkovModel::MarkovModel() {}
+
+MarkovModel::~MarkovModel() {}
+
+void MarkovModel::generateFromSequence(const Array<Note> &sortedSelection, int order)
 {
+    this->clear();
+    this->order = jlimit(1, MarkovModel::maxOrder, order);
+
+    this->tokenize(sortedSelection, true);
+    this->countFrequencies();
 }
 
-MarkovModel::~MarkovModel()
+void MarkovModel::setSourceSequence(WeakReference<MidiSequence> sequence, int order)
 {
-    delete StateMatrix;
-    delete InitialStateVector;
+    this->clear();
+    this->order = jlimit(1, MarkovModel::maxOrder, order);
+
+    if (sequence == nullptr)
+    {
+        return;
+    }
+
+    this->sourceSequence = sequence;
+
+    // midi sequences are always sorted
+    Array<Note> notes;
+    notes.ensureStorageAllocated(sequence->size());
+    for (int i = 0; i < sequence->size(); ++i)
+    {
+        const auto *event = sequence->getUnchecked(i);
+        if (event->isTypeOf(MidiEvent::Type::Note))
+        {
+            notes.add(*static_cast<const Note *>(event));
+        }
+    }
+
+    this->tokenize(notes, true);
+    this->countFrequencies();
+
+    // the same grouping as in tokenize(), each slot corresponds to one state
+    size_t stateIndex = 0;
+    int i = 0;
+    while (i < notes.size())
+    {
+        const auto beat = notes.getReference(i).getBeat();
+        auto slot = this->timeline.emplace_hint(this->timeline.end(), beat, Slot());
+        getAllNotesFromBeat(notes, i, slot->second.notes);
+        slot->second.state = this->sequence[stateIndex++];
+    }
 }
 
-void MarkovModel::generateFromSequence(Array<Note> sortedSelection)
+void MarkovModel::clear()
 {
-    if (false)
-    {
-        generateSingleNoteChain(sortedSelection);
-    } else
+    this->states.clear();
+    this->soundFrequency.clear();
+    this->transitionFrequency.clear();
+    this->order = 1;
+
+    this->sequence.clear();
+    this->sequenceBreaks.clear();
+    this->transitionMatrix.clear();
+    this->contexts.clear();
+    this->initialStateVector.clear();
+    this->initialSamplingTables.clear();
+    this->transitionSamplingTables.clear();
+    this->sequenceIsOutdated = false;
+    this->matrixIsOutdated = false;
+    this->samplingTablesAreOutdated = false;
+
+    this->timeline.clear();
+    this->sourceSequence = nullptr;
+}
+
+void MarkovModel::countFrequencies()
+{
+    // count the sound objects and the first-order transitions
+    this->soundFrequency.assign(this->states.size(), 0);
+    this->transitionFrequency.reserve(this->sequence.size());
+
+    for (size_t i = 0; i < this->sequence.size(); ++i)
     {
-        generateMultiNoteChain(sortedSelection);
+        const auto state = this->sequence[i];
+        this->soundFrequency[state] += 1;
+
+        if (i > 0)
+        {
+            this->transitionFrequency[packTransition(this->sequence[i - 1], state)] += 1;
+        }
     }
 
-    this->buildMatrix();
-    this->buildInitialVector();
+    this->matrixIsOutdated = true;
+}
+
+int MarkovModel::getSoundFrequency(StateId state) const noexcept
+{
+    return state < this->soundFrequency.size() ? this->soundFrequency[state] : 0;
 }
 
-void MarkovModel::generateSingleNoteChain(const Array<Note>& sortedSelection)
+int MarkovModel::getTransitionFrequency(StateId from, StateId to) const noexcept
 {
-    float lastBeat = sortedSelection.getReference(sortedSelection.size() - 1).getBeat();
+    const auto found = this->transitionFrequency.find(packTransition(from, to));
+    return found != this->transitionFrequency.end() ? found->second : 0;
+}
+
+const std::vector<MarkovModel::StateId> &MarkovModel::getSequence() const
+{
+    this->updateIfNeeded();
+    return this->sequence;
+}
+
+const MarkovTransitionMatrix &MarkovModel::getTransitionMatrix() const
+{
+    this->updateIfNeeded();
+    return this->transitionMatrix;
+}
+
+const MarkovContextTrie &MarkovModel::getContexts() const
+{
+    this->updateIfNeeded();
+    return this->contexts;
+}
 
-    for (int i = 0; i < sortedSelection.size() - 1; ++i)
+void MarkovModel::tokenize(const Array<Note> &sortedSelection, bool useChords)
+{
+    this->sequence.reserve(sortedSelection.size());
+
+    // the scratch buffer is reused for all chords, so that
+    // only the sound objects seen for the first time are copied
+    std::vector<Note> chord;
+
+    int i = 0;
+    while (i < sortedSelection.size())
     {
-        Note left = sortedSelection.getReference(i);
-        Note right = sortedSelection.getReference(i + 1);
+        getAllNotesFromBeat(sortedSelection, i, chord);
+
+        const auto state = useChords ?
+            this->states.intern(chord) :
+            this->states.intern(chord.front());
+
+        this->sequence.push_back(state);
+    }
+}
+
+void MarkovModel::getAllNotesFromBeat(const Array<Note> &sortedSelection,
+    int &index, std::vector<Note> &outChord)
+{
+    jassert(index < sortedSelection.size());
 
-        int offset = 0;
+    outChord.clear();
 
-        if (left.getBeat() == lastBeat)
+    const auto beat = sortedSelection.getReference(index).getBeat();
+    while (index < sortedSelection.size() &&
+        sortedSelection.getReference(index).getBeat() == beat)
+    {
+        outChord.push_back(sortedSelection.getReference(index));
+        index++;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Lazy rebuilds
+//===----------------------------------------------------------------------===//
+
+void MarkovModel::updateIfNeeded() const
+{
+    if (this->sequenceIsOutdated)
+    {
+        this->sequence.clear();
+        this->sequence.reserve(this->timeline.size());
+        for (const auto &it : this->timeline)
         {
-            this->States.insert(left);
-            this->SoundFrequency[left] += 1;
-            break;
+            this->sequence.push_back(it.second.state);
         }
 
-        while (left.getBeat() == right.getBeat())
+        this->sequenceIsOutdated = false;
+    }
+
+    if (this->matrixIsOutdated)
+    {
+        this->buildMatrix();
+        this->buildInitialVector();
+
+        // the first-order transitions are already in the matrix,
+        // only build the context trie when longer histories are needed
+        this->contexts.clear();
+        if (this->order > 1)
         {
-            offset++;
-            right = sortedSelection.getReference(i + offset + 1);
+            this->contexts.build(this->sequence, this->sequenceBreaks,
+                this->Size(), this->order);
         }
 
-        i += offset;
+        this->matrixIsOutdated = false;
+        this->samplingTablesAreOutdated = true;
+    }
+}
+
+void MarkovModel::buildMatrix() const
+{
+    // one pass over the frequencies table, no remapping needed,
+    // since the interned ids are already dense
+    std::vector<MarkovTransitionMatrix::Transition> transitions;
+    transitions.reserve(this->transitionFrequency.size());
 
-        this->TransitionFrequency[{left, right}] += 1;
-        this->SoundFrequency[left] += 1;
-        this->States.insert(left);
+    for (const auto &it : this->transitionFrequency)
+    {
+        const auto from = MarkovTransitionMatrix::StateId(it.first >> 32);
+        const auto to = MarkovTransitionMatrix::StateId(it.first & 0xffffffff);
+        transitions.push_back({ from, to, it.second });
     }
+
+    this->transitionMatrix.build(this->Size(), transitions);
 }
 
-void MarkovModel::generateMultiNoteChain(const Array<Note>& sortedSelection)
+void MarkovModel::buildInitialVector() const
 {
-    int i = 0;
-    while (i <= sortedSelection.size() - 1)
-    {
-        std::vector<Note> prev = getAllNotesFromBeat(sortedSelection, i);
-        std::vector<Note> next = getAllNotesFromBeat(sortedSelection, i);
-        if (i < sortedSelection.size()) {
-            i -= next.size();
-        } else {
-            this->SoundFrequency[next] += 1;
-            this->States.insert(next);
+    this->initialStateVector.clear();
+
+    int sum = 0;
+    for (const auto count : this->soundFrequency)
+    {
+        sum += count;
+    }
+
+    if (sum == 0)
+    {
+        return;
+    }
+
+    this->initialStateVector.resize(this->soundFrequency.size());
+
+    int cumulativeCount = 0;
+    for (size_t i = 0; i < this->soundFrequency.size(); ++i)
+    {
+        cumulativeCount += this->soundFrequency[i];
+        this->initialStateVector[i] = float(cumulativeCount) / float(sum);
+    }
+
+    this->initialStateVector.back() = 1.f;
+}
+
+//===----------------------------------------------------------------------===//
+// Sampling
+//===----------------------------------------------------------------------===//
+
+MarkovModel::StateId MarkovModel::sampleInitialState(float random) const
+{
+    this->updateIfNeeded();
+
+    if (this->initialStateVector.empty())
+    {
+        return MarkovStatesDictionary::invalidId;
+    }
+
+    const auto found = std::upper_bound(this->initialStateVector.begin(),
+        this->initialStateVector.end(), random);
+
+    if (found == this->initialStateVector.end())
+    {
+        return StateId(this->initialStateVector.size() - 1);
+    }
+
+    return StateId(std::distance(this->initialStateVector.begin(), found));
+}
+
+MarkovModel::StateId MarkovModel::sampleNextState(StateId state, float random) const
+{
+    this->updateIfNeeded();
+
+    const auto next = this->transitionMatrix.sample(MarkovTransitionMatrix::StateId(state), random);
+    return next < 0 ? MarkovStatesDictionary::invalidId : StateId(next);
+}
+
+MarkovModel::StateId MarkovModel::sampleNextState(const StateId *history,
+    int historySize, float random) const
+{
+    if (historySize <= 0)
+    {
+        return this->sampleInitialState(random);
+    }
+
+    this->updateIfNeeded();
+
+    if (this->order == 1 || this->contexts.isEmpty())
+    {
+        return this->sampleNextState(history[historySize - 1], random);
+    }
+
+    const auto next = this->contexts.sample(history, historySize, random);
+    return next < 0 ? MarkovStatesDictionary::invalidId : StateId(next);
+}
+
+const MarkovTransitionMatrix &MarkovModel::getSamplingMatrix() const
+{
+    this->updateIfNeeded();
+    return this->order > 1 ?
+        this->contexts.getContinuations() :
+        this->transitionMatrix;
+}
+
+const MarkovAliasTables &MarkovModel::getInitialSamplingTables() const
+{
+    this->getTransitionSamplingTables();
+    return this->initialSamplingTables;
+}
+
+const MarkovAliasTables &MarkovModel::getTransitionSamplingTables() const
+{
+    const auto &matrix = this->getSamplingMatrix();
+
+    if (this->samplingTablesAreOutdated)
+    {
+        const std::vector<int> initialRow = { 0, int(this->soundFrequency.size()) };
+        this->initialSamplingTables.build(initialRow, this->soundFrequency);
+        this->transitionSamplingTables.build(matrix.getRowOffsets(), matrix.getCounts());
+        this->samplingTablesAreOutdated = false;
+    }
+
+    return this->transitionSamplingTables;
+}
+
+//===----------------------------------------------------------------------===//
+// Sidecar files
+//===----------------------------------------------------------------------===//
+
+Result MarkovModel::saveToFile(const File &file, bool withSamplingTables) const
+{
+    FileOutputStream fileStream(file);
+    if (!fileStream.openedOk())
+    {
+        return Result::fail("Failed to save");
+    }
+
+    fileStream.setPosition(0);
+    fileStream.truncate();
+
+    MarkovBinaryFormat::Writer writer(fileStream);
+    this->writeTo(writer, withSamplingTables);
+
+    fileStream.flush();
+    return fileStream.getStatus();
+}
+
+Result MarkovModel::loadFromFile(const File &file)
+{
+    // the file is only mapped for the duration of loading:
+    // all the tables are bulk-copied, and nothing is parsed item by item,
+    // except for the sounds dictionary and the hash tables for lookups
+    MemoryMappedFile mappedFile(file, MemoryMappedFile::readOnly);
+    if (mappedFile.getData() == nullptr)
+    {
+        this->clear();
+        return Result::fail("Failed to load");
+    }
+
+    MarkovBinaryFormat::Reader reader(mappedFile.getData(), mappedFile.getSize());
+    if (!this->readFrom(reader))
+    {
+        return Result::fail("Failed to load");
+    }
+
+    return Result::ok();
+}
+
+void MarkovModel::writeTo(MarkovBinaryFormat::Writer &writer, bool withSamplingTables) const
+{
+    this->updateIfNeeded();
+
+    if (withSamplingTables)
+    {
+        this->getTransitionSamplingTables();
+    }
+
+    writer.write(kMarkovHeader);
+    writer.write(kMarkovFormatVersion);
+    writer.write(int32(this->order));
+    writer.write(withSamplingTables ? kHasSamplingTables : uint32(0));
+
+    this->states.writeTo(writer);
+    writer.write(this->soundFrequency);
+    writer.write(this->sequence);
+    writer.write(this->sequenceBreaks);
+    this->transitionMatrix.writeTo(writer);
+
+    if (this->order > 1)
+    {
+        this->contexts.writeTo(writer);
+    }
+
+    if (withSamplingTables)
+    {
+        this->initialSamplingTables.writeTo(writer);
+        this->transitionSamplingTables.writeTo(writer);
+    }
+}
+
+bool MarkovModel::readFrom(MarkovBinaryFormat::Reader &reader)
+{
+    this->clear();
+
+    uint64 header = 0;
+    uint32 version = 0;
+    int32 newOrder = 0;
+    uint32 flags = 0;
+
+    // the header check also fails on big-endian machines, which is intended
+    if (!reader.read(header) || header != kMarkovHeader ||
+        !reader.read(version) || version < 1 || version > kMarkovFormatVersion ||
+        !reader.read(newOrder) || newOrder < 1 || newOrder > MarkovModel::maxOrder ||
+        !reader.read(flags))
+    {
+        return false;
+    }
+
+    this->order = newOrder;
+
+    bool isValid = this->states.readFrom(reader) &&
+        reader.read(this->soundFrequency) &&
+        reader.read(this->sequence) &&
+        this->soundFrequency.size() == size_t(this->Size());
+
+    for (size_t i = 0; isValid && i < this->sequence.size(); ++i)
+    {
+        isValid = this->sequence[i] < StateId(this->Size());
+    }
+
+    // the first version had no sequence breaks
+    if (isValid && version > 1)
+    {
+        isValid = reader.read(this->sequenceBreaks);
+
+        int previousBreak = 0;
+        for (size_t i = 0; isValid && i < this->sequenceBreaks.size(); ++i)
+        {
+            const auto sequenceBreak = this->sequenceBreaks[i];
+            isValid = sequenceBreak >= previousBreak &&
+                size_t(sequenceBreak) <= this->sequence.size();
+            previousBreak = sequenceBreak;
         }
+    }
 
-        this->TransitionFrequency[{prev, next}] += 1;
+    isValid = isValid &&
+        this->transitionMatrix.readFrom(reader, this->Size()) &&
+        this->transitionMatrix.getNumStates() == this->Size();
+
+    if (isValid && this->order > 1)
+    {
+        isValid = this->contexts.readFrom(reader, this->Size());
+    }
+
+    if (isValid && (flags & kHasSamplingTables) != 0)
+    {
+        const auto &samplingMatrix = this->order > 1 ?
+            this->contexts.getContinuations() : this->transitionMatrix;
 
-        this->SoundFrequency[prev] += 1;
-        this->States.insert(prev);
+        const std::vector<int> initialRow = { 0, int(this->soundFrequency.size()) };
+        isValid = this->initialSamplingTables.readFrom(reader, initialRow) &&
+            this->transitionSamplingTables.readFrom(reader, samplingMatrix.getRowOffsets());
     }
+
+    if (!isValid || reader.hasFailed())
+    {
+        this->clear();
+        return false;
+    }
+
+    // restore the lookup table from the matrix,
+    // which has exactly the same first-order counts
+    const auto &rowOffsets = this->transitionMatrix.getRowOffsets();
+    const auto &columns = this->transitionMatrix.getColumns();
+    const auto &counts = this->transitionMatrix.getCounts();
+
+    this->transitionFrequency.reserve(columns.size());
+    for (int r = 0; r < this->transitionMatrix.getNumStates(); ++r)
+    {
+        for (int i = rowOffsets[r]; i < rowOffsets[r + 1]; ++i)
+        {
+            this->transitionFrequency[packTransition(StateId(r), StateId(columns[i]))] = counts[i];
+        }
+    }
+
+    this->buildInitialVector();
+    this->samplingTablesAreOutdated = (flags & kHasSamplingTables) == 0;
+    return true;
 }
 
-std::vector<Note> MarkovModel::getAllNotesFromBeat(const Array<Note>& sortedSelection, int& index)
+//===----------------------------------------------------------------------===//
+// Serializable
+//===----------------------------------------------------------------------===//
+
+SerializedData MarkovModel::serialize() const
 {
-    std::vector<Note> chord;
-    Note note = sortedSelection.getReference(index);
-    chord.push_back(note);
-    float beat = note.getBeat();
+    using namespace Serialization;
+    SerializedData tree(Midi::Markov::markovModel);
+
+    // same binary image as in the sidecar files, minus the sampling tables,
+    // as base64, like any other binary data in the documents
+    MemoryOutputStream stream;
+    MarkovBinaryFormat::Writer writer(stream);
+    this->writeTo(writer, false);
+
+    tree.setProperty(Midi::Markov::data, stream.getMemoryBlock().toBase64Encoding());
+    return tree;
+}
 
-    while (beat == note.getBeat())
+void MarkovModel::deserialize(const SerializedData &data)
+{
+    this->reset();
+    using namespace Serialization;
+
+    const auto root = data.hasType(Midi::Markov::markovModel) ?
+        data : data.getChildWithName(Midi::Markov::markovModel);
+
+    if (!root.isValid())
     {
-        index++;
-        if (index <= sortedSelection.size() - 1 &&
-            sortedSelection.getReference(index).getBeat() == beat) {
-            note = sortedSelection.getReference(index);
-        } else {
-            break;
+        return;
+    }
+
+    MemoryBlock block;
+    if (block.fromBase64Encoding(root.getProperty(Midi::Markov::data).toString()))
+    {
+        MarkovBinaryFormat::Reader reader(block.getData(), block.getSize());
+        this->readFrom(reader);
+    }
+}
+
+void MarkovModel::reset()
+{
+    this->clear();
+}
+
+//===----------------------------------------------------------------------===//
+// ProjectListener
+//===----------------------------------------------------------------------===//
+
+void MarkovModel::onAddMidiEvent(const MidiEvent &event)
+{
+    if (this->isSourceEvent(event))
+    {
+        this->addNote(static_cast<const Note &>(event));
+    }
+}
+
+void MarkovModel::onChangeMidiEvent(const MidiEvent &oldEvent, const MidiEvent &newEvent)
+{
+    if (this->isSourceEvent(newEvent))
+    {
+        this->changeNote(static_cast<const Note &>(oldEvent),
+            static_cast<const Note &>(newEvent));
+    }
+}
+
+void MarkovModel::onRemoveMidiEvent(const MidiEvent &event)
+{
+    if (this->isSourceEvent(event))
+    {
+        this->removeNote(static_cast<const Note &>(event));
+    }
+}
+
+void MarkovModel::onRemoveTrack(MidiTrack *const track)
+{
+    if (this->sourceSequence != nullptr &&
+        track->getSequence() == this->sourceSequence.get())
+    {
+        this->clear();
+    }
+}
+
+void MarkovModel::onReloadProjectContent(const Array<MidiTrack *> &tracks,
+    const ProjectMetadata *meta)
+{
+    // the source might have been replaced entirely, e.g. on vcs reset,
+    // so the only option is to start over, if it still exists
+    if (this->sourceSequence != nullptr)
+    {
+        this->setSourceSequence(this->sourceSequence, this->order);
+    }
+    else
+    {
+        this->clear();
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Incremental updates
+//===----------------------------------------------------------------------===//
+
+bool MarkovModel::isSourceEvent(const MidiEvent &event) const noexcept
+{
+    return this->sourceSequence != nullptr &&
+        event.isTypeOf(MidiEvent::Type::Note) &&
+        event.getSequence() == this->sourceSequence.get();
+}
+
+static void insertSorted(std::vector<Note> &notes, const Note &note)
+{
+    const auto position = std::upper_bound(notes.begin(), notes.end(), note,
+        [](const Note &a, const Note &b) { return Note::compareElements(a, b) < 0; });
+
+    notes.insert(position, note);
+}
+
+static bool eraseById(std::vector<Note> &notes, const Note &note)
+{
+    const auto found = std::find_if(notes.begin(), notes.end(),
+        [&note](const Note &n) { return n.getId() == note.getId(); });
+
+    if (found == notes.end())
+    {
+        return false;
+    }
+
+    notes.erase(found);
+    return true;
+}
+
+void MarkovModel::addNote(const Note &note)
+{
+    auto slot = this->timeline.find(note.getBeat());
+    if (slot == this->timeline.end())
+    {
+        slot = this->timeline.emplace(note.getBeat(), Slot()).first;
+    }
+
+    insertSorted(slot->second.notes, note);
+    this->updateSlot(slot);
+}
+
+void MarkovModel::removeNote(const Note &note)
+{
+    const auto slot = this->timeline.find(note.getBeat());
+    if (slot == this->timeline.end() || !eraseById(slot->second.notes, note))
+    {
+        jassertfalse;
+        return;
+    }
+
+    this->updateSlot(slot);
+}
+
+void MarkovModel::changeNote(const Note &oldNote, const Note &newNote)
+{
+    // when the note is moved to another beat, removing and adding it
+    // leaves both slots in their final states, so nothing transient is interned
+    if (oldNote.getBeat() != newNote.getBeat())
+    {
+        this->removeNote(oldNote);
+        this->addNote(newNote);
+        return;
+    }
+
+    // otherwise the chord without the note would be interned for nothing
+    const auto slot = this->timeline.find(oldNote.getBeat());
+    if (slot == this->timeline.end() || !eraseById(slot->second.notes, oldNote))
+    {
+        jassertfalse;
+        return;
+    }
+
+    insertSorted(slot->second.notes, newNote);
+    this->updateSlot(slot);
+}
+
+void MarkovModel::updateSlot(Timeline::iterator slot)
+{
+    const auto oldState = slot->second.state;
+    const auto newState = slot->second.notes.empty() ?
+        MarkovStatesDictionary::invalidId :
+        this->states.intern(slot->second.notes);
+
+    if (oldState == newState)
+    {
+        return; // e.g. the velocity has changed
+    }
+
+    // all other slots in the timeline are never empty
+    const auto prevState = (slot == this->timeline.begin()) ?
+        MarkovStatesDictionary::invalidId : std::prev(slot)->second.state;
+
+    const auto nextSlot = std::next(slot);
+    const auto nextState = (nextSlot == this->timeline.end()) ?
+        MarkovStatesDictionary::invalidId : nextSlot->second.state;
+
+    const bool hasPrev = prevState != MarkovStatesDictionary::invalidId;
+    const bool hasNext = nextState != MarkovStatesDictionary::invalidId;
+
+    if (oldState != MarkovStatesDictionary::invalidId)
+    {
+        this->addSoundFrequency(oldState, -1);
+        if (hasPrev) { this->addTransitionFrequency(prevState, oldState, -1); }
+        if (hasNext) { this->addTransitionFrequency(oldState, nextState, -1); }
+    }
+    else if (hasPrev && hasNext)
+    {
+        // a new slot splits the transition between its neighbours
+        this->addTransitionFrequency(prevState, nextState, -1);
+    }
+
+    if (newState != MarkovStatesDictionary::invalidId)
+    {
+        this->addSoundFrequency(newState, 1);
+        if (hasPrev) { this->addTransitionFrequency(prevState, newState, 1); }
+        if (hasNext) { this->addTransitionFrequency(newState, nextState, 1); }
+        slot->second.state = newState;
+    }
+    else
+    {
+        if (hasPrev && hasNext)
+        {
+            // the removed slot's neighbours are now connected
+            this->addTransitionFrequency(prevState, nextState, 1);
         }
-        chord.push_back(note);
+
+        this->timeline.erase(slot);
+    }
+
+    this->sequenceIsOutdated = true;
+    this->matrixIsOutdated = true;
+}
+
+void MarkovModel::addSoundFrequency(StateId state, int delta)
+{
+    if (state >= this->soundFrequency.size())
+    {
+        this->soundFrequency.resize(this->states.size(), 0);
     }
 
-    return chord;
+    this->soundFrequency[state] += delta;
+    jassert(this->soundFrequency[state] >= 0);
 }
 
-void MarkovModel::buildMatrix()
+void MarkovModel::addTransitionFrequency(StateId from, StateId to, int delta)
 {
-    this->StateMatrix = new dsp::Matrix<float>(this->Size(), this->Size());
+    const auto key = packTransition(from, to);
+    auto &count = this->transitionFrequency[key];
+    count += delta;
+    jassert(count >= 0);
 
-    for (int r = 0; r < Size(); ++r)
+    if (count <= 0)
     {
-        auto itRow = this->States.begin();
-        std::advance(itRow, r);
+        this->transitionFrequency.erase(key);
+    }
+}
+
+#if JUCE_UNIT_TESTS
+
+#include "MarkovGenerator.h"
+
+class MarkovModelFormatTests final : public UnitTest
+{
+public:
+
+    MarkovModelFormatTests() :
+        UnitTest("Markov model binary format tests", UnitTestCategories::helio) {}
 
-        int sum = 0;
-        for (int c = 0; c < this->Size(); ++c)
+    void runTest() override
+    {
+        const auto notes = makeNotes(this->getRandom());
+
+        for (const auto order : { 1, 3 })
         {
-            auto itCol = this->States.begin();
-            std::advance(itCol, c);
+            beginTest("Write and read back, order " + String(order));
+
+            MarkovModel model;
+            model.generateFromSequence(notes, order);
 
-            auto row = *itRow;
-            auto col = *itCol;
+            TemporaryFile file;
+            expect(model.saveToFile(file.getFile(), true).wasOk());
 
-            auto it = this->TransitionFrequency.find({row, col});
-            if (it != this->TransitionFrequency.end()) {
-                sum += it->second;
+            MarkovModel loaded;
+            expect(loaded.loadFromFile(file.getFile()).wasOk());
+            expectEquals(loaded.getOrder(), order);
+            expectEquals(loaded.Size(), model.Size());
+            expect(loaded.getSequence() == model.getSequence());
+
+            const MarkovStatesDictionary::SoundEqual equal;
+            for (int i = 0; i < model.Size(); ++i)
+            {
+                expect(equal(loaded.getStates().getSound(StateId(i)),
+                    model.getStates().getSound(StateId(i))));
             }
+
+            expectEquals(loaded.getSamplingMatrix().getNumTransitions(),
+                model.getSamplingMatrix().getNumTransitions());
+
+            // the loaded sampling tables are the same as the built ones
+            expect(MarkovGenerator(loaded).generate(1000, kSeed) ==
+                MarkovGenerator(model).generate(1000, kSeed));
         }
 
-        if (sum == 0) continue;
+        beginTest("Corrupted input rejection");
+
+        MarkovModel model;
+        model.generateFromSequence(notes, 1);
+
+        TemporaryFile file;
+        expect(model.saveToFile(file.getFile(), true).wasOk());
+
+        MemoryBlock image;
+        expect(file.getFile().loadFileAsData(image));
+
+        // the file ends with the transition sampling tables:
+        // the probabilities array and the aliases array, each prefixed with its size
+        const auto numTransitions = model.getSamplingMatrix().getNumTransitions();
+        const auto tableSize = getPaddedSize(size_t(numTransitions) * sizeof(int32));
+        const auto aliasesOffset = image.getSize() - tableSize;
+        const auto probabilitiesOffset = aliasesOffset - sizeof(uint64) - tableSize;
+        const auto versionOffset = sizeof(uint64);
 
-        float prob[this->Size()];
-        for (int c = 0; c < this->Size(); ++c)
+        this->expectRejected(file, image, versionOffset, uint32(0));
+        this->expectRejected(file, image, versionOffset, uint32(kMarkovFormatVersion + 1));
+        this->expectRejected(file, image, aliasesOffset, int32(-1));
+        this->expectRejected(file, image, aliasesOffset, int32(model.Size()));
+        this->expectRejected(file, image, probabilitiesOffset, std::numeric_limits<float>::quiet_NaN());
+        this->expectRejected(file, image, probabilitiesOffset, 1.5f);
+        this->expectRejected(file, image, probabilitiesOffset, -0.5f);
+
+        // and the truncated file
+        MemoryBlock truncated(image.getData(), image.getSize() - MarkovBinaryFormat::alignment);
+        expect(file.getFile().replaceWithData(truncated.getData(), truncated.getSize()));
+        this->expectRejected(file);
+
+        // finally, make sure that the unchanged image is still fine
+        expect(file.getFile().replaceWithData(image.getData(), image.getSize()));
+        MarkovModel loaded;
+        expect(loaded.loadFromFile(file.getFile()).wasOk());
+        expectEquals(loaded.Size(), model.Size());
+    }
+
+private:
+
+    using StateId = MarkovModel::StateId;
+
+    static constexpr int64 kSeed = 12345;
+
+    static Array<Note> makeNotes(Random random)
+    {
+        Array<Note> notes;
+        float beat = 0.f;
+        for (int i = 0; i < 500; ++i)
         {
-            auto itCol = this->States.begin();
-            std::advance(itCol, c);
+            const auto key = 48 + random.nextInt(24);
+            const auto length = float(1 + random.nextInt(4)) * 0.25f;
+            notes.add(Note(nullptr, key, beat, length, 0.75f));
+
+            // chords sometimes
+            if (random.nextInt(4) == 0)
+            {
+                notes.add(Note(nullptr, key + 4, beat, length, 0.75f));
+            }
 
-            (*this->StateMatrix)(r,c) = float(this->TransitionFrequency[{*itRow, *itCol}] / sum);
-            prob[c] = float(this->TransitionFrequency[{*itRow, *itCol}] / sum);
+            beat += length;
         }
+
+        return notes;
     }
-}
 
-void MarkovModel::buildInitialVector()
-{
-    float prob[this->Size()];
-    this->InitialStateVector = new dsp::Matrix<float>(1, this->Size());
-    int sum = 0;
-    for (auto it = this->SoundFrequency.begin(); it != this->SoundFrequency.end(); ++it) {
-        sum += it->second;
+    static size_t getPaddedSize(size_t numBytes)
+    {
+        const auto alignment = size_t(MarkovBinaryFormat::alignment);
+        return (numBytes + alignment - 1) / alignment * alignment;
     }
 
-    for (int i = 0; i < Size(); ++i)
+    template <typename T>
+    void expectRejected(TemporaryFile &file, const MemoryBlock &image, size_t offset, T value)
     {
-        auto it = this->SoundFrequency.begin();
-        std::advance(it, i);
-        (*this->InitialStateVector)(0, i) = float(it->second / sum);
-        prob[i] = float(it->second / sum);
+        MemoryBlock corrupted(image);
+        corrupted.copyFrom(&value, int(offset), sizeof(T));
+        expect(file.getFile().replaceWithData(corrupted.getData(), corrupted.getSize()));
+        this->expectRejected(file);
     }
-}
\ No newline at end of file
+
+    void expectRejected(TemporaryFile &file)
+    {
+        MarkovModel loaded;
+        expect(loaded.loadFromFile(file.getFile()).failed());
+        expectEquals(loaded.Size(), 0);
+    }
+};
+
+static MarkovModelFormatTests markovModelFormatTests;
+
+#endif
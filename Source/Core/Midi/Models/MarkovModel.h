@@ -2,147 +2,231 @@
 
 #include "Common.h"
 #include "JuceHeader.h"
-#include "juce_dsp/juce_dsp.h"
-#include "../../ThirdParty/HopscotchMap/include/tsl/hopscotch_map.h"
 #include "Note.h"
-#include <variant>
+#include "ProjectListener.h"
+#include "MarkovStatesDictionary.h"
+#include "MarkovTransitionMatrix.h"
+#include "MarkovContextTrie.h"
+#include "MarkovAliasTables.h"
+#include <map>
+
+class MidiSequence;
+
+// The model can either be trained once on a selection, or bound to a source
+// sequence: in the latter case, it needs to be subscribed to the project's
+// changes by the owner, and it will apply the note edits as local deltas
+// to the frequencies of the affected sound objects and transitions only;
+// the sparse matrices, the context trie and the initial distribution
+// are only rebuilt when requested after any changes.
+//
+// Trained models can be saved as sidecar files, which are designed to be
+// memory-mapped and read with bulk copies, so that even large models load
+// without re-parsing any midi; the same binary image is used when a model
+// is serialized as a part of a document.
+
+class MarkovModel final : public ProjectListener, public Serializable
+{
+public:
+
+    using Sound = MarkovStatesDictionary::Sound;
+    using StateId = MarkovStatesDictionary::Id;
+
+    static constexpr int maxOrder = MarkovContextTrie::maxOrder;
 
-#include <cmath>
+    MarkovModel();
+    ~MarkovModel() override;
 
+    // Number of all sound objects or states of the model
+    int Size() const noexcept
+    {
+        return this->states.size();
+    }
 
-class MarkovModel {
-    // Sound Object is either a single Note, multiple Notes or Rest
-    using Sound = std::variant<Note, std::vector<Note>, float>;
-    // Rest is characterized by its length (float)
+    // The order is the number of previous sound objects the next one
+    // depends on; for orders above 1, unseen contexts back off to shorter ones
+    void generateFromSequence(const Array<Note> &sortedSelection, int order = 1);
+    void clear();
 
-    template <class T>
-    constexpr static void hash_combine(std::size_t& seed, const T& v) noexcept
+    // Trains the model on the whole sequence and keeps it up to date
+    // on any subsequent changes, until cleared or bound to another one
+    void setSourceSequence(WeakReference<MidiSequence> sequence, int order = 1);
+
+    MidiSequence *getSourceSequence() const noexcept
     {
-        std::hash<T> hasher;
-        seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+        return this->sourceSequence.get();
     }
 
-    constexpr static void hash_note(std::size_t& seed, const Note& n) noexcept
+    int getOrder() const noexcept
     {
-        hash_combine(seed, n.getKey());
-        //hash_combine(result, int(this->beat * Globals::ticksPerBeat));
-        hash_combine(seed, int(n.getLength() * Globals::ticksPerBeat));
+        return this->order;
     }
 
-    struct SoundHash {
-        std::size_t operator()(const Sound & sound) const {
-            HashCode result = 0;
-            if (std::holds_alternative<Note>(sound)) {
-                hash_note(result, std::get<Note>(sound));
-            } else if (std::holds_alternative<std::vector<Note>>(sound)) {
-                for (const auto& note : std::get<std::vector<Note>>(sound)) {
-                    hash_note(result, note);
-                }
-            } else if (std::holds_alternative<float>(sound)) {
-                constexpr std::hash<float> hasher;
-                result = hasher(std::get<float>(sound));
-            }
-            return result;
-        }
-    };
+    const MarkovStatesDictionary &getStates() const noexcept
+    {
+        return this->states;
+    }
 
-    struct PairHash {
-        std::size_t operator()(const std::pair<Sound, Sound>& pair) const {
-            HashCode result = 0;
-            constexpr SoundHash hasher;
-            hash_combine(result, hasher(pair.first));
-            hash_combine(result, hasher(pair.second));
-            return result;
-        }
-    };
+    // The source sequence as a list of state ids
+    const std::vector<StateId> &getSequence() const;
 
-    struct NoteEqual {
-        bool operator()(const Note &lhs, const Note &rhs) const
-        {
-            return lhs.getKey() == rhs.getKey() && lhs.getLength() == rhs.getLength();
-        }
-    };
+    // How often a sound object appears
+    int getSoundFrequency(StateId state) const noexcept;
+
+    // How often a sound object is followed by another one
+    int getTransitionFrequency(StateId from, StateId to) const noexcept;
+
+    // Probability matrix based on the transition frequencies,
+    // rows and columns are the interned state ids
+    const MarkovTransitionMatrix &getTransitionMatrix() const;
+
+    // Contexts of the higher-order chain, empty for the first-order model
+    const MarkovContextTrie &getContexts() const;
+
+    // Both return invalidId if the model is empty or the state is a dead end
+    StateId sampleInitialState(float random) const;
+    StateId sampleNextState(StateId state, float random) const;
+
+    // Uses up to getOrder() last items of the history, the last one being
+    // the most recent state; the first-order model only looks at the last one
+    StateId sampleNextState(const StateId *history, int historySize, float random) const;
+
+    // The matrix the generator samples from: the first-order transitions,
+    // or the continuations of the context trie for the higher orders
+    const MarkovTransitionMatrix &getSamplingMatrix() const;
+
+    // Alias tables for the generator, built on demand, or loaded from a file
+    const MarkovAliasTables &getInitialSamplingTables() const;
+    const MarkovAliasTables &getTransitionSamplingTables() const;
+
+    //===------------------------------------------------------------------===//
+    // Sidecar files
+    //===------------------------------------------------------------------===//
+
+    // The sampling tables are optional, they make the file larger,
+    // but save precomputing them after loading
+    Result saveToFile(const File &file, bool withSamplingTables) const;
+
+    // The loaded model is not bound to any source sequence
+    Result loadFromFile(const File &file);
+
+    //===------------------------------------------------------------------===//
+    // Serializable
+    //===------------------------------------------------------------------===//
+
+    SerializedData serialize() const override;
+    void deserialize(const SerializedData &data) override;
+    void reset() override;
+
+    //===------------------------------------------------------------------===//
+    // ProjectListener
+    //===------------------------------------------------------------------===//
+
+    void onAddMidiEvent(const MidiEvent &event) override;
+    void onChangeMidiEvent(const MidiEvent &oldEvent, const MidiEvent &newEvent) override;
+    void onRemoveMidiEvent(const MidiEvent &event) override;
+    void onRemoveTrack(MidiTrack *const track) override;
+    void onReloadProjectContent(const Array<MidiTrack *> &tracks,
+        const ProjectMetadata *meta) override;
+
+private:
 
-    struct SoundEqual
+    // Splits the selection into the sound objects and interns them,
+    // either using only single Notes (ignores Chords), or Arrays of Notes
+    void tokenize(const Array<Note> &sortedSelection, bool useChords);
+
+    // Collects all Notes that start at the same beat in an array
+    static void getAllNotesFromBeat(const Array<Note> &sortedSelection,
+        int &index, std::vector<Note> &outChord);
+
+    void countFrequencies();
+
+    // Rebuilds whatever is derived from the frequencies, if they have changed
+    void updateIfNeeded() const;
+
+    void buildMatrix() const;
+    void buildInitialVector() const;
+
+    void writeTo(MarkovBinaryFormat::Writer &writer, bool withSamplingTables) const;
+    bool readFrom(MarkovBinaryFormat::Reader &reader);
+
+    static inline uint64 packTransition(StateId from, StateId to) noexcept
     {
-        bool operator()(const Sound &lhs, const Sound &rhs) const
-        {
-            NoteEqual equal;
-            if (std::holds_alternative<Note>(lhs) && std::holds_alternative<Note>(rhs)) {
-                return equal(std::get<Note>(lhs), std::get<Note>(rhs));
-            } if (std::holds_alternative<std::vector<Note>>(lhs)
-                && std::holds_alternative<std::vector<Note>>(rhs))
-            {
-                auto left = std::get<std::vector<Note>>(lhs).begin();
-                auto right = std::get<std::vector<Note>>(rhs).begin();
-                for (int i = 0; i < std::get<std::vector<Note>>(rhs).size(); ++i)
-                {
-                    std::advance(left, i);
-                    std::advance(right, i);
-                    if (!equal(*left, *right))
-                    {
-                        return false;
-                    }
-                }
-                return true;
-            } if (std::holds_alternative<float>(lhs)
-                && std::holds_alternative<float>(rhs))
-            {
-                return std::get<float>(lhs) == std::get<float>(rhs);
-            }
-            return false;
-        }
-    };
+        return (uint64(from) << 32) | uint64(to);
+    }
 
-    struct PairEqual {
-        bool operator()(const std::pair<Sound, Sound> &pair1, const std::pair<Sound, Sound> &pair2) const {
-            constexpr SoundEqual equal;
-            return equal(pair1.first, pair2.first) && equal(pair1.second, pair2.second);
-        }
-    };
+    // All Sound Objects of the Chain
+    MarkovStatesDictionary states;
 
-    public:
-    MarkovModel();
-    ~MarkovModel();
+    // Counts how often a sound object appears,
+    // indexed by state id
+    std::vector<int> soundFrequency;
 
     // Counts the Transitions from a Sound Object to another
     // {from, to} -> count
-    std::unordered_map<std::pair<Sound, Sound>, int, PairHash, PairEqual> TransitionFrequency;
+    FlatHashMap<uint64, int> transitionFrequency;
 
-    // Probability matrix based on TransitionFrequency
-    dsp::Matrix<float>* StateMatrix;
+    int order = 1;
 
-    // Counts how often a sound object appears
-    // {sound} -> count
-    std::unordered_map<Sound, int, SoundHash, SoundEqual> SoundFrequency;
+    //===------------------------------------------------------------------===//
+    // Derived from the frequencies, rebuilt lazily
+    //===------------------------------------------------------------------===//
 
-    // Probability vector based on SoundFrequency and states
-    dsp::Matrix<float>* InitialStateVector;
+    // The tokenized source sequence
+    mutable std::vector<StateId> sequence;
+    mutable bool sequenceIsOutdated = false;
 
-    // All Sound Objects of the Chain
-    std::unordered_set<Sound, SoundHash, SoundEqual> States;
+    // Sorted indices where the independent pieces of the sequence start,
+    // only the models trained on a corpus have them
+    std::vector<int> sequenceBreaks;
 
-    // Number of all sound objects or states of the model
-    int Size() const {
-        return static_cast<int>(this->States.size());
-    }
+    mutable MarkovTransitionMatrix transitionMatrix;
+    mutable MarkovContextTrie contexts;
+
+    // Cumulative probability vector based on the sound frequencies,
+    // indexed by state id
+    mutable std::vector<float> initialStateVector;
 
-    void generateFromSequence(Array<Note> sortedSelection);
+    mutable bool matrixIsOutdated = false;
 
-    //saveToFile
-    //loadFromFile
+    mutable MarkovAliasTables initialSamplingTables;
+    mutable MarkovAliasTables transitionSamplingTables;
+    mutable bool samplingTablesAreOutdated = false;
 
-    private:
+    //===------------------------------------------------------------------===//
+    // Incremental updates
+    //===------------------------------------------------------------------===//
 
-    // Use only single Notes for the Model (ignores Chords)
-    void generateSingleNoteChain(const Array<Note>& sortedSelection);
+    // All notes starting at the same beat, sorted like in the sequence,
+    // and the sound object they make up
+    struct Slot final
+    {
+        std::vector<Note> notes;
+        StateId state = MarkovStatesDictionary::invalidId;
+    };
 
-    // Use Arrays of Notes for the Model
-    void generateMultiNoteChain(const Array<Note>& sortedSelection);
+    // The mirror of the source sequence, beat -> chord
+    using Timeline = std::map<float, Slot>;
+    Timeline timeline;
 
-    // Collects all Notes that start at the same beat in an array
-    static std::vector<Note> getAllNotesFromBeat(const Array<Note>& sortedSelection, int& index);
+    WeakReference<MidiSequence> sourceSequence;
+
+    bool isSourceEvent(const MidiEvent &event) const noexcept;
+
+    void addNote(const Note &note);
+    void removeNote(const Note &note);
+
+    // Updates the note's slot in place, if the beat is the same
+    void changeNote(const Note &oldNote, const Note &newNote);
+
+    // Re-interns the slot after its notes have changed, and moves
+    // the frequencies of the old sound object and its transitions
+    // with the neighbours to the new one; removes the slot if it's empty
+    void updateSlot(Timeline::iterator slot);
+
+    void addTransitionFrequency(StateId from, StateId to, int delta);
+    void addSoundFrequency(StateId state, int delta);
+
+    friend class MarkovCorpusTrainer;
 
-    void buildMatrix();
-    void buildInitialVector();
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MarkovModel)
 };
@@ -0,0 +1,302 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovStatesDictionary.h"
+
+static inline void hashCombine(HashCode &seed, HashCode value) noexcept
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static inline void hashNote(HashCode &seed, const Note &note) noexcept
+{
+    hashCombine(seed, std::hash<int>()(note.getKey()));
+    hashCombine(seed, std::hash<int>()(int(note.getLength() * Globals::ticksPerBeat)));
+}
+
+static inline bool notesEqual(const Note &lhs, const Note &rhs) noexcept
+{
+    return lhs.getKey() == rhs.getKey() && lhs.getLength() == rhs.getLength();
+}
+
+static inline bool chordsEqual(const std::vector<Note> &lhs, const std::vector<Note> &rhs) noexcept
+{
+    if (lhs.size() != rhs.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.size(); ++i)
+    {
+        if (!notesEqual(lhs[i], rhs[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+HashCode MarkovStatesDictionary::SoundHash::operator()(const Sound &sound) const noexcept
+{
+    if (const auto *note = std::get_if<Note>(&sound))
+    {
+        return (*this)(*note);
+    }
+    else if (const auto *chord = std::get_if<std::vector<Note>>(&sound))
+    {
+        return (*this)(*chord);
+    }
+    else if (const auto *rest = std::get_if<float>(&sound))
+    {
+        return std::hash<float>()(*rest);
+    }
+
+    return 0;
+}
+
+HashCode MarkovStatesDictionary::SoundHash::operator()(const Note &note) const noexcept
+{
+    HashCode result = 0;
+    hashNote(result, note);
+    return result;
+}
+
+HashCode MarkovStatesDictionary::SoundHash::operator()(const std::vector<Note> &chord) const noexcept
+{
+    HashCode result = 0;
+    for (const auto &note : chord)
+    {
+        hashNote(result, note);
+    }
+
+    return result;
+}
+
+bool MarkovStatesDictionary::SoundEqual::operator()(const Sound &lhs, const Sound &rhs) const noexcept
+{
+    if (const auto *note = std::get_if<Note>(&lhs))
+    {
+        return (*this)(*note, rhs);
+    }
+    else if (const auto *chord = std::get_if<std::vector<Note>>(&lhs))
+    {
+        return (*this)(*chord, rhs);
+    }
+
+    const auto *rest = std::get_if<float>(&lhs);
+    const auto *otherRest = std::get_if<float>(&rhs);
+    return rest != nullptr && otherRest != nullptr && *rest == *otherRest;
+}
+
+bool MarkovStatesDictionary::SoundEqual::operator()(const Note &lhs, const Sound &rhs) const noexcept
+{
+    const auto *note = std::get_if<Note>(&rhs);
+    return note != nullptr && notesEqual(lhs, *note);
+}
+
+bool MarkovStatesDictionary::SoundEqual::operator()(const std::vector<Note> &lhs, const Sound &rhs) const noexcept
+{
+    const auto *chord = std::get_if<std::vector<Note>>(&rhs);
+    return chord != nullptr && chordsEqual(lhs, *chord);
+}
+
+template <typename T>
+MarkovStatesDictionary::Id MarkovStatesDictionary::internImpl(const T &key)
+{
+    const auto found = this->ids.find(key);
+    if (found != this->ids.end())
+    {
+        return found->second;
+    }
+
+    // only copy the sound object when it's seen for the first time,
+    // and only into the sounds table, the map refers to it from there
+    const auto newId = Id(this->sounds.size());
+    jassert(newId != MarkovStatesDictionary::invalidId);
+
+    this->sounds.emplace_back(key);
+    this->ids.emplace(&this->sounds.back(), newId);
+    return newId;
+}
+
+MarkovStatesDictionary::Id MarkovStatesDictionary::intern(const Sound &sound)
+{
+    return this->internImpl(sound);
+}
+
+MarkovStatesDictionary::Id MarkovStatesDictionary::intern(const Note &note)
+{
+    return this->internImpl(note);
+}
+
+MarkovStatesDictionary::Id MarkovStatesDictionary::intern(const std::vector<Note> &chord)
+{
+    return this->internImpl(chord);
+}
+
+MarkovStatesDictionary::Id MarkovStatesDictionary::find(const Sound &sound) const
+{
+    const auto found = this->ids.find(sound);
+    return found != this->ids.end() ? found->second : MarkovStatesDictionary::invalidId;
+}
+
+void MarkovStatesDictionary::reserve(int numSounds)
+{
+    this->ids.reserve(numSounds);
+}
+
+void MarkovStatesDictionary::clear()
+{
+    this->ids.clear();
+    this->sounds.clear();
+}
+
+//===----------------------------------------------------------------------===//
+// Binary format
+//===----------------------------------------------------------------------===//
+
+enum class SoundKind : uint8
+{
+    Note = 0,
+    Chord = 1,
+    Rest = 2
+};
+
+void MarkovStatesDictionary::writeTo(MarkovBinaryFormat::Writer &writer) const
+{
+    // the sounds table is flattened into the columns of notes' parameters,
+    // and each sound is a range in them; a rest is a single pseudo-note
+    std::vector<uint8> kinds;
+    std::vector<int32> offsets;
+    std::vector<int32> keys;
+    std::vector<float> lengths;
+    std::vector<float> velocities;
+
+    kinds.reserve(this->sounds.size());
+    offsets.reserve(this->sounds.size() + 1);
+    offsets.push_back(0);
+
+    const auto addNote = [&](int32 key, float length, float velocity)
+    {
+        keys.push_back(key);
+        lengths.push_back(length);
+        velocities.push_back(velocity);
+    };
+
+    for (const auto &sound : this->sounds)
+    {
+        if (const auto *note = std::get_if<Note>(&sound))
+        {
+            kinds.push_back(uint8(SoundKind::Note));
+            addNote(note->getKey(), note->getLength(), note->getVelocity());
+        }
+        else if (const auto *chord = std::get_if<std::vector<Note>>(&sound))
+        {
+            kinds.push_back(uint8(SoundKind::Chord));
+            for (const auto &chordNote : *chord)
+            {
+                addNote(chordNote.getKey(), chordNote.getLength(), chordNote.getVelocity());
+            }
+        }
+        else if (const auto *rest = std::get_if<float>(&sound))
+        {
+            kinds.push_back(uint8(SoundKind::Rest));
+            addNote(0, *rest, 0.f);
+        }
+
+        offsets.push_back(int32(keys.size()));
+    }
+
+    writer.write(kinds);
+    writer.write(offsets);
+    writer.write(keys);
+    writer.write(lengths);
+    writer.write(velocities);
+}
+
+bool MarkovStatesDictionary::readFrom(MarkovBinaryFormat::Reader &reader)
+{
+    this->clear();
+
+    std::vector<uint8> kinds;
+    std::vector<int32> offsets;
+    std::vector<int32> keys;
+    std::vector<float> lengths;
+    std::vector<float> velocities;
+
+    if (!reader.read(kinds) || !reader.read(offsets) ||
+        !reader.read(keys) || !reader.read(lengths) || !reader.read(velocities) ||
+        offsets.size() != kinds.size() + 1 || offsets.front() != 0 ||
+        size_t(offsets.back()) != keys.size() ||
+        lengths.size() != keys.size() || velocities.size() != keys.size())
+    {
+        reader.fail();
+        return false;
+    }
+
+    this->reserve(int(kinds.size()));
+
+    std::vector<Note> chord;
+    for (size_t i = 0; i < kinds.size(); ++i)
+    {
+        const auto start = offsets[i];
+        const auto end = offsets[i + 1];
+        const auto makeNote = [&](int32 n)
+        {
+            return Note(nullptr, keys[n], 0.f, lengths[n], velocities[n]);
+        };
+
+        const auto expectedId = Id(i);
+        auto id = MarkovStatesDictionary::invalidId;
+
+        if (start < 0 || start > end || size_t(end) > keys.size() ||
+            (kinds[i] != uint8(SoundKind::Chord) && end - start != 1))
+        {
+            id = MarkovStatesDictionary::invalidId;
+        }
+        else if (kinds[i] == uint8(SoundKind::Note))
+        {
+            id = this->intern(makeNote(start));
+        }
+        else if (kinds[i] == uint8(SoundKind::Chord))
+        {
+            chord.clear();
+            for (auto n = start; n < end; ++n)
+            {
+                chord.push_back(makeNote(n));
+            }
+
+            id = this->intern(chord);
+        }
+        else if (kinds[i] == uint8(SoundKind::Rest))
+        {
+            id = this->intern(Sound(lengths[start]));
+        }
+
+        // a duplicate or malformed sound means the file is corrupted
+        if (id != expectedId)
+        {
+            reader.fail();
+            this->clear();
+            return false;
+        }
+    }
+
+    return true;
+}
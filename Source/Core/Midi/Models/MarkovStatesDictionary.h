@@ -0,0 +1,149 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Note.h"
+#include "MarkovBinaryFormat.h"
+#include <deque>
+#include <variant>
+#include <vector>
+
+// The interning table for the Markov model's states:
+// each distinct sound object is hashed and compared only once, when it is
+// first seen, and all the model's counters are then keyed by compact ids;
+// ids are stable for the lifetime of the dictionary, i.e. never reused,
+// even if the sound object is no longer present in the source sequence.
+
+class MarkovStatesDictionary final
+{
+public:
+
+    // Sound object is either a single Note, multiple Notes or a Rest,
+    // the rest is characterized by its length
+    using Sound = std::variant<Note, std::vector<Note>, float>;
+
+    using Id = uint32;
+    static constexpr Id invalidId = 0xffffffff;
+
+    // Sound objects are considered equal when their keys and lengths are,
+    // the other note parameters, like the velocity, are taken from the first
+    // occurrence of the sound object, which is stored in the dictionary;
+    // both functors are transparent, so that notes and chords can be
+    // looked up without wrapping them into a variant (i.e. copying chords);
+    // the hash map is keyed by pointers to the sounds table entries
+    struct SoundHash final
+    {
+        using is_transparent = void;
+
+        HashCode operator()(const Sound &sound) const noexcept;
+        HashCode operator()(const Note &note) const noexcept;
+        HashCode operator()(const std::vector<Note> &chord) const noexcept;
+
+        HashCode operator()(const Sound *sound) const noexcept
+        {
+            return (*this)(*sound);
+        }
+    };
+
+    struct SoundEqual final
+    {
+        using is_transparent = void;
+
+        bool operator()(const Sound &lhs, const Sound &rhs) const noexcept;
+
+        bool operator()(const Note &lhs, const Sound &rhs) const noexcept;
+        bool operator()(const Sound &lhs, const Note &rhs) const noexcept
+        {
+            return (*this)(rhs, lhs);
+        }
+
+        bool operator()(const std::vector<Note> &lhs, const Sound &rhs) const noexcept;
+        bool operator()(const Sound &lhs, const std::vector<Note> &rhs) const noexcept
+        {
+            return (*this)(rhs, lhs);
+        }
+
+        bool operator()(const Sound *lhs, const Sound *rhs) const noexcept
+        {
+            return (*this)(*lhs, *rhs);
+        }
+
+        template <typename T>
+        bool operator()(const T &lhs, const Sound *rhs) const noexcept
+        {
+            return (*this)(lhs, *rhs);
+        }
+
+        template <typename T>
+        bool operator()(const Sound *lhs, const T &rhs) const noexcept
+        {
+            return (*this)(*lhs, rhs);
+        }
+    };
+
+    MarkovStatesDictionary() = default;
+
+    // the hash map points into the sounds table, which keeps its
+    // elements in place when moved, but a copy would point to the original
+    MarkovStatesDictionary(MarkovStatesDictionary &&other) = default;
+    MarkovStatesDictionary &operator=(MarkovStatesDictionary &&other) = default;
+
+    // Returns the id of the existing equal sound, or adds a new one
+    Id intern(const Sound &sound);
+    Id intern(const Note &note);
+    Id intern(const std::vector<Note> &chord);
+
+    // Returns invalidId, if not found
+    Id find(const Sound &sound) const;
+
+    inline const Sound &getSound(Id id) const noexcept
+    {
+        jassert(id < this->sounds.size());
+        return this->sounds[id];
+    }
+
+    inline int size() const noexcept
+    {
+        return int(this->sounds.size());
+    }
+
+    inline bool isEmpty() const noexcept
+    {
+        return this->sounds.empty();
+    }
+
+    void reserve(int numSounds);
+    void clear();
+
+    // All sounds are written in the order of their ids,
+    // so that reading them back keeps the ids the same
+    void writeTo(MarkovBinaryFormat::Writer &writer) const;
+    bool readFrom(MarkovBinaryFormat::Reader &reader);
+
+private:
+
+    template <typename T>
+    Id internImpl(const T &key);
+
+    // a deque never relocates its elements on growth,
+    // so each sound object is stored once, and the map only refers to it
+    std::deque<Sound> sounds;
+    FlatHashMap<const Sound *, Id, SoundHash, SoundEqual> ids;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MarkovStatesDictionary)
+};
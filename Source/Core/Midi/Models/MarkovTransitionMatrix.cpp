@@ -0,0 +1,244 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Common.h"
+#include "MarkovTransitionMatrix.h"
+
+void MarkovTransitionMatrix::build(int numRows, int numColumns,
+    const std::vector<Transition> &transitions)
+{
+    this->clear();
+
+    if (numRows <= 0 || numColumns <= 0)
+    {
+        return;
+    }
+
+    const auto numTransitions = transitions.size();
+
+    // two passes of counting sort, first by target state, then by source state,
+    // which is stable, so that each row ends up being sorted by the target state;
+    // both passes are linear, no need to sort the rows individually
+
+    std::vector<int> columnOffsets(numColumns + 1, 0);
+    for (const auto &t : transitions)
+    {
+        jassert(t.to >= 0 && t.to < numColumns);
+        columnOffsets[t.to + 1]++;
+    }
+
+    for (int i = 0; i < numColumns; ++i)
+    {
+        columnOffsets[i + 1] += columnOffsets[i];
+    }
+
+    std::vector<const Transition *> byColumn(numTransitions);
+    for (const auto &t : transitions)
+    {
+        byColumn[columnOffsets[t.to]++] = &t;
+    }
+
+    this->rowOffsets.assign(numRows + 1, 0);
+    for (const auto &t : transitions)
+    {
+        jassert(t.from >= 0 && t.from < numRows);
+        this->rowOffsets[t.from + 1]++;
+    }
+
+    for (int i = 0; i < numRows; ++i)
+    {
+        this->rowOffsets[i + 1] += this->rowOffsets[i];
+    }
+
+    this->columns.resize(numTransitions);
+    this->counts.resize(numTransitions);
+
+    std::vector<int> rowCursors(this->rowOffsets.begin(), this->rowOffsets.end() - 1);
+    for (const auto *t : byColumn)
+    {
+        const auto i = rowCursors[t->from]++;
+        this->columns[i] = t->to;
+        this->counts[i] = t->count;
+    }
+
+    this->buildDistributions();
+}
+
+void MarkovTransitionMatrix::buildDistributions()
+{
+    const auto numRows = this->getNumStates();
+    this->rowTotals.assign(numRows, 0);
+    this->cumulative.resize(this->counts.size());
+
+    for (int r = 0; r < numRows; ++r)
+    {
+        for (int i = this->rowOffsets[r]; i < this->rowOffsets[r + 1]; ++i)
+        {
+            this->rowTotals[r] += this->counts[i];
+        }
+    }
+
+    // row-wise cumulative distributions
+    for (int r = 0; r < numRows; ++r)
+    {
+        const auto total = this->rowTotals[r];
+        if (total <= 0)
+        {
+            continue;
+        }
+
+        int sum = 0;
+        const auto rowEnd = this->rowOffsets[r + 1];
+        for (int i = this->rowOffsets[r]; i < rowEnd; ++i)
+        {
+            sum += this->counts[i];
+            this->cumulative[i] = float(sum) / float(total);
+        }
+
+        // make sure there's no rounding gap at the end of the row
+        this->cumulative[rowEnd - 1] = 1.f;
+    }
+}
+
+void MarkovTransitionMatrix::writeTo(MarkovBinaryFormat::Writer &writer) const
+{
+    writer.write(this->rowOffsets);
+    writer.write(this->columns);
+    writer.write(this->counts);
+}
+
+bool MarkovTransitionMatrix::readFrom(MarkovBinaryFormat::Reader &reader, int numColumns)
+{
+    this->clear();
+
+    if (!reader.read(this->rowOffsets) ||
+        !reader.read(this->columns) ||
+        !reader.read(this->counts))
+    {
+        this->clear();
+        return false;
+    }
+
+    // all the invariants the lookups rely on
+    bool isValid = this->counts.size() == this->columns.size() &&
+        (this->rowOffsets.empty() ? this->columns.empty() :
+            (this->rowOffsets.front() == 0 &&
+             size_t(this->rowOffsets.back()) == this->columns.size()));
+
+    for (size_t r = 1; isValid && r < this->rowOffsets.size(); ++r)
+    {
+        const auto rowStart = this->rowOffsets[r - 1];
+        const auto rowEnd = this->rowOffsets[r];
+        isValid = rowStart <= rowEnd;
+
+        for (auto i = rowStart; isValid && i < rowEnd; ++i)
+        {
+            isValid = this->columns[i] >= 0 && this->columns[i] < numColumns &&
+                this->counts[i] > 0 && (i == rowStart || this->columns[i - 1] < this->columns[i]);
+        }
+    }
+
+    if (!isValid)
+    {
+        reader.fail();
+        this->clear();
+        return false;
+    }
+
+    this->buildDistributions();
+    return true;
+}
+
+void MarkovTransitionMatrix::clear() noexcept
+{
+    this->rowOffsets.clear();
+    this->columns.clear();
+    this->counts.clear();
+    this->cumulative.clear();
+    this->rowTotals.clear();
+}
+
+int MarkovTransitionMatrix::getRowSize(StateId from) const noexcept
+{
+    if (from < 0 || from >= this->getNumStates())
+    {
+        return 0;
+    }
+
+    return this->rowOffsets[from + 1] - this->rowOffsets[from];
+}
+
+int MarkovTransitionMatrix::getRowTotal(StateId from) const noexcept
+{
+    if (from < 0 || from >= this->getNumStates())
+    {
+        return 0;
+    }
+
+    return this->rowTotals[from];
+}
+
+int MarkovTransitionMatrix::getCount(StateId from, StateId to) const noexcept
+{
+    const auto i = this->findIndex(from, to);
+    return i < 0 ? 0 : this->counts[i];
+}
+
+float MarkovTransitionMatrix::getProbability(StateId from, StateId to) const noexcept
+{
+    const auto i = this->findIndex(from, to);
+    if (i < 0)
+    {
+        return 0.f;
+    }
+
+    return float(this->counts[i]) / float(this->rowTotals[from]);
+}
+
+MarkovTransitionMatrix::StateId MarkovTransitionMatrix::sample(StateId from, float random) const noexcept
+{
+    if (this->getRowSize(from) == 0)
+    {
+        return -1;
+    }
+
+    const auto rowStart = this->cumulative.begin() + this->rowOffsets[from];
+    const auto rowEnd = this->cumulative.begin() + this->rowOffsets[from + 1];
+    const auto found = std::upper_bound(rowStart, rowEnd, random);
+    const auto i = (found == rowEnd) ? (this->rowOffsets[from + 1] - 1) :
+        int(std::distance(this->cumulative.begin(), found));
+
+    return this->columns[i];
+}
+
+int MarkovTransitionMatrix::findIndex(StateId from, StateId to) const noexcept
+{
+    if (this->getRowSize(from) == 0)
+    {
+        return -1;
+    }
+
+    const auto rowStart = this->columns.begin() + this->rowOffsets[from];
+    const auto rowEnd = this->columns.begin() + this->rowOffsets[from + 1];
+    const auto found = std::lower_bound(rowStart, rowEnd, to);
+    if (found == rowEnd || *found != to)
+    {
+        return -1;
+    }
+
+    return int(std::distance(this->columns.begin(), found));
+}
@@ -0,0 +1,107 @@
+/*
+    This file is part of Helio music sequencer.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MarkovBinaryFormat.h"
+#include <vector>
+
+// The transitions table of the Markov model in a compressed sparse row form:
+// a typical chain built from a real piece of music has a couple of distinct
+// continuations for each state, so storing the dense states x states matrix
+// is a waste of memory; here each row only keeps the observed transitions,
+// sorted by the target state, and the row-wise cumulative distributions,
+// so that both lookups and sampling are a binary search within one row.
+
+class MarkovTransitionMatrix final
+{
+public:
+
+    using StateId = int;
+
+    struct Transition final
+    {
+        StateId from;
+        StateId to;
+        int count;
+    };
+
+    MarkovTransitionMatrix() = default;
+
+    // Assumes that all transitions are unique and all ids are in [0 .. numStates)
+    inline void build(int numStates, const std::vector<Transition> &transitions)
+    {
+        this->build(numStates, numStates, transitions);
+    }
+
+    // Rows don't have to be the states themselves, e.g. the context trie
+    // uses its nodes as rows, and the states they are followed by as columns
+    void build(int numRows, int numColumns, const std::vector<Transition> &transitions);
+    void clear() noexcept;
+
+    inline int getNumStates() const noexcept
+    {
+        return this->rowOffsets.empty() ? 0 : int(this->rowOffsets.size()) - 1;
+    }
+
+    inline int getNumTransitions() const noexcept
+    {
+        return int(this->columns.size());
+    }
+
+    inline bool isEmpty() const noexcept
+    {
+        return this->columns.empty();
+    }
+
+    int getRowSize(StateId from) const noexcept;
+    int getRowTotal(StateId from) const noexcept;
+    int getCount(StateId from, StateId to) const noexcept;
+    float getProbability(StateId from, StateId to) const noexcept;
+
+    // Picks the next state for the given random value in [0 .. 1),
+    // returns -1 if the state has no observed continuations
+    StateId sample(StateId from, float random) const noexcept;
+
+    void writeTo(MarkovBinaryFormat::Writer &writer) const;
+    bool readFrom(MarkovBinaryFormat::Reader &reader, int numColumns);
+
+    // Raw rows access, e.g. for building the sampling tables
+    inline const std::vector<int> &getRowOffsets() const noexcept { return this->rowOffsets; }
+    inline const std::vector<StateId> &getColumns() const noexcept { return this->columns; }
+    inline const std::vector<int> &getCounts() const noexcept { return this->counts; }
+
+private:
+
+    // numRows + 1 items, row r occupies [rowOffsets[r] .. rowOffsets[r + 1])
+    std::vector<int> rowOffsets;
+
+    // nnz items each
+    std::vector<StateId> columns;
+    std::vector<int> counts;
+    std::vector<float> cumulative;
+
+    // numRows items
+    std::vector<int> rowTotals;
+
+    int findIndex(StateId from, StateId to) const noexcept;
+
+    // Computes the row totals and the cumulative distributions
+    void buildDistributions();
+
+    JUCE_LEAK_DETECTOR(MarkovTransitionMatrix)
+};
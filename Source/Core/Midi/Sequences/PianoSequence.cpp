@@ -52,6 +52,21 @@ void PianoSequence::importMidi(const MidiMessageSequence &sequence,
     this->clearUndoHistory();
     this->checkpoint();
 
+    Array<Note> notes;
+    PianoSequence::readMidiNotes(this, sequence, timeFormat, filterByChannel, notes);
+
+    for (const auto &note : notes)
+    {
+        this->importMidiEvent<Note>(note);
+    }
+
+    this->updateBeatRange(false);
+}
+
+void PianoSequence::readMidiNotes(WeakReference<MidiSequence> owner,
+    const MidiMessageSequence &sequence, short timeFormat,
+    Optional<int> filterByChannel, Array<Note> &outNotes)
+{
     for (int i = 0; i < sequence.getNumEvents(); ++i)
     {
         const auto &message = sequence.getEventPointer(i)->message;
@@ -75,14 +90,11 @@ void PianoSequence::importMidi(const MidiMessageSequence &sequence,
                 if (endBeat > startBeat)
                 {
                     const float length = endBeat - startBeat;
-                    const Note note(this, key, startBeat, length, velocity);
-                    this->importMidiEvent<Note>(note);
+                    outNotes.add(Note(owner, key, startBeat, length, velocity));
                 }
             }
         }
     }
-
-    this->updateBeatRange(false);
 }
 
 //===----------------------------------------------------------------------===//
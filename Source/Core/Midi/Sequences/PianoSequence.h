@@ -57,6 +57,13 @@ public:
     void importMidi(const MidiMessageSequence &sequence,
         short timeFormat, Optional<int> filterByChannel) override;
 
+    // The notes parsing part of the import; the notes are in the order
+    // of their note-on messages; with no owner, it doesn't touch any
+    // project's state, so that it can be used headless, in worker threads
+    static void readMidiNotes(WeakReference<MidiSequence> owner,
+        const MidiMessageSequence &sequence, short timeFormat,
+        Optional<int> filterByChannel, Array<Note> &outNotes);
+
     //===------------------------------------------------------------------===//
     // Undoable track editing
     //===------------------------------------------------------------------===//
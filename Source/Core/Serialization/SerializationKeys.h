@@ -141,6 +141,31 @@ namespace Serialization
             static const Identifier name = "name";
             static const Identifier map = "map";
         }
+
+        namespace Markov
+        {
+            static const Identifier markovModel = "markovModel";
+            static const Identifier data = "data";
+
+            namespace Benchmark
+            {
+                static const Identifier results = "markovBenchmark";
+                static const Identifier version = "version";
+                static const Identifier testCase = "case";
+                static const Identifier name = "name";
+                static const Identifier order = "order";
+                static const Identifier numNotes = "numNotes";
+                static const Identifier numFiles = "numFiles";
+                static const Identifier chordDensity = "chordDensity";
+                static const Identifier numStates = "numStates";
+                static const Identifier numTransitions = "numTransitions";
+                static const Identifier buildMs = "buildMs";
+                static const Identifier normaliseMs = "normaliseMs";
+                static const Identifier samplingTablesMs = "samplingTablesMs";
+                static const Identifier samplesPerSecond = "samplesPerSecond";
+                static const Identifier peakMemoryMb = "peakMemoryMb";
+            } // namespace Benchmark
+        }
     } // namespace Midi
 
     namespace Modifiers
@@ -106,6 +106,9 @@ CommandIDs::Id CommandIDs::getIdForName(const String &command)
         CASE_FOR(PopupMenuDismiss)
         CASE_FOR(RenderToFLAC)
         CASE_FOR(RenderToWAV)
+        CASE_FOR(RenderToAIFF)
+        CASE_FOR(RenderToOGG)
+        CASE_FOR(RenderToRAW)
         CASE_FOR(ImportMidi)
         CASE_FOR(ExportMidi)
         CASE_FOR(DeleteProject)
@@ -305,6 +308,9 @@ I18n::Key CommandIDs::getTranslationKeyFor(CommandIDs::Id id)
         TRANS_NONE(PopupMenuDismiss)
         TRANS_KEY(RenderToFLAC, Menu::Project::renderFlac)
         TRANS_KEY(RenderToWAV, Menu::Project::renderWav)
+        TRANS_KEY(RenderToAIFF, Menu::Project::renderAiff)
+        TRANS_KEY(RenderToOGG, Menu::Project::renderOgg)
+        TRANS_KEY(RenderToRAW, Menu::Project::renderRaw)
         TRANS_KEY(ImportMidi, Menu::Project::importMidi)
         TRANS_KEY(ExportMidi, Menu::Project::renderMidi)
         TRANS_KEY(DeleteProject, Menu::Project::deleteConfirm)
@@ -120,6 +120,9 @@ namespace CommandIDs
 
         RenderToFLAC                    = 0x2030,
         RenderToWAV                     = 0x2031,
+        RenderToAIFF                    = 0x2032,
+        RenderToOGG                     = 0x2033,
+        RenderToRAW                     = 0x2034,
 
         ImportMidi                      = 0x2050,
         ExportMidi                      = 0x2051,
@@ -240,7 +243,7 @@ namespace CommandIDs
         MakeLegatoOverlapping           = 0x4604, // connect notes together, but with a slight overlap for use in certain VSTs
         Glue                            = 0x4605, // glue overlapping notes
 
-        StartMarkovMode                 = 0x4700,
+        StartMarkovMode                 = 0x4700, // more ids reserved for chain orders
 
         YourNextCommandId               = 0x4800
     };
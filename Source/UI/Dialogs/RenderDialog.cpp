@@ -84,6 +84,24 @@ void RenderDialog::SimpleWaveformProgressBar::update(float newProgress,
 // Render dialog
 //===----------------------------------------------------------------------===//
 
+static constexpr int renderBitDepths[] = { 16, 24, 32 };
+static constexpr int renderBlockSizes[] = { 128, 256, 512, 1024, 2048, 4096 };
+
+// the lossy and the raw formats ignore the bit depth, and FLAC is limited to 24 bits
+static bool supportsBitDepth(RenderFormat format, int bitDepth) noexcept
+{
+    switch (format)
+    {
+    case RenderFormat::WAV:
+    case RenderFormat::AIFF:
+        return true;
+    case RenderFormat::FLAC:
+        return bitDepth <= 24;
+    default:
+        return false;
+    }
+}
+
 RenderDialog::RenderDialog(ProjectNode &parentProject,
     const URL &target, RenderFormat format) :
     project(parentProject),
@@ -123,12 +141,85 @@ RenderDialog::RenderDialog(ProjectNode &parentProject,
     this->pathLabel->setJustificationType(Justification::centredLeft);
     this->pathLabel->setInterceptsMouseClicks(false, false);
 
+    this->bitDepthLabel = make<Label>();
+    this->addChildComponent(this->bitDepthLabel.get());
+    this->bitDepthLabel->setFont(Globals::UI::Fonts::M);
+    this->bitDepthLabel->setJustificationType(Justification::centredLeft);
+    this->bitDepthLabel->setInterceptsMouseClicks(false, false);
+    this->bitDepthLabel->setText(TRANS(I18n::Dialog::renderBitDepth), dontSendNotification);
+
+    for (const auto bitDepth : renderBitDepths)
+    {
+        auto *button = this->bitDepthButtons.add(new ToggleButton(String(bitDepth)));
+        this->addChildComponent(button);
+        button->setWantsKeyboardFocus(false);
+        button->onClick = [this, bitDepth]() {
+            this->options.bitDepth = bitDepth;
+            this->updateOptionButtons();
+        };
+    }
+
+    this->blockSizeLabel = make<Label>();
+    this->addChildComponent(this->blockSizeLabel.get());
+    this->blockSizeLabel->setFont(Globals::UI::Fonts::M);
+    this->blockSizeLabel->setJustificationType(Justification::centredLeft);
+    this->blockSizeLabel->setInterceptsMouseClicks(false, false);
+    this->blockSizeLabel->setText(TRANS(I18n::Dialog::renderBlockSize), dontSendNotification);
+
+    for (const auto blockSize : renderBlockSizes)
+    {
+        auto *button = this->blockSizeButtons.add(new ToggleButton(String(blockSize)));
+        this->addChildComponent(button);
+        button->setWantsKeyboardFocus(false);
+        button->onClick = [this, blockSize]() {
+            this->options.blockSize = blockSize;
+            this->updateOptionButtons();
+        };
+    }
+
+    this->stemsButton = make<ToggleButton>(TRANS(I18n::Dialog::renderStems));
+    this->addChildComponent(this->stemsButton.get());
+    this->stemsButton->setWantsKeyboardFocus(false);
+    this->stemsButton->onClick = [this]() {
+        this->options.renderStems = this->stemsButton->getToggleState();
+    };
+
+    this->doublePrecisionButton = make<ToggleButton>(TRANS(I18n::Dialog::renderDoublePrecision));
+    this->addChildComponent(this->doublePrecisionButton.get());
+    this->doublePrecisionButton->setWantsKeyboardFocus(false);
+    this->doublePrecisionButton->onClick = [this]() {
+        this->options.doublePrecision = this->doublePrecisionButton->getToggleState();
+    };
+
+    // the options don't fit into the phone dialog, so the defaults are used there
+    if (!isPhoneLayout)
+    {
+        const auto hasBitDepth = supportsBitDepth(this->format, this->options.bitDepth);
+        this->bitDepthLabel->setVisible(hasBitDepth);
+        for (int i = 0; i < this->bitDepthButtons.size(); ++i)
+        {
+            this->bitDepthButtons.getUnchecked(i)->
+                setVisible(hasBitDepth && supportsBitDepth(this->format, renderBitDepths[i]));
+        }
+
+        this->blockSizeLabel->setVisible(true);
+        for (auto *button : this->blockSizeButtons)
+        {
+            button->setVisible(true);
+        }
+
+        this->stemsButton->setVisible(true);
+        this->doublePrecisionButton->setVisible(true);
+    }
+
     // just in case..
     this->project.getTransport().stopPlaybackAndRecording();
 
-    this->setSize(562, isPhoneLayout? 120 : 185);
+    this->setSize(562, isPhoneLayout? 120 : 275);
     this->updatePosition();
     this->updateRenderTargetLabels();
+    this->updateOptionButtons();
+    this->setOptionButtonsEnabled(true);
 }
 
 RenderDialog::~RenderDialog() = default;
@@ -136,16 +227,40 @@ RenderDialog::~RenderDialog() = default;
 void RenderDialog::resized()
 {
     constexpr auto browseButtonSize = 24;
+    const auto hasOptions = this->blockSizeLabel->isVisible();
+    const auto pathRowProportion = hasOptions ? 0.1f : 0.2f;
 
     this->captionLabel->setBounds(this->getCaptionBounds());
 
-    this->browseButton->setBounds(this->getRowBounds(0.2f, browseButtonSize)
+    this->browseButton->setBounds(this->getRowBounds(pathRowProportion, browseButtonSize)
         .withWidth(browseButtonSize).translated(2, 0));
 
-    this->pathLabel->setBounds(this->getRowBounds(0.2f, browseButtonSize)
+    this->pathLabel->setBounds(this->getRowBounds(pathRowProportion, browseButtonSize)
         .withTrimmedLeft(browseButtonSize));
 
-    this->progressBar->setBounds(this->getRowBounds(0.7f, 38).reduced(5, 0));
+    this->progressBar->setBounds(this->getRowBounds(hasOptions ? 0.34f : 0.7f, 38).reduced(5, 0));
+
+    constexpr auto optionRowSize = 28;
+    constexpr auto optionLabelSize = 120;
+    constexpr auto optionButtonSize = 64;
+
+    auto bitDepthRow = this->getRowBounds(0.56f, optionRowSize, 5);
+    this->bitDepthLabel->setBounds(bitDepthRow.removeFromLeft(optionLabelSize));
+    for (auto *button : this->bitDepthButtons)
+    {
+        button->setBounds(bitDepthRow.removeFromLeft(optionButtonSize));
+    }
+
+    auto blockSizeRow = this->getRowBounds(0.74f, optionRowSize, 5);
+    this->blockSizeLabel->setBounds(blockSizeRow.removeFromLeft(optionLabelSize));
+    for (auto *button : this->blockSizeButtons)
+    {
+        button->setBounds(blockSizeRow.removeFromLeft(optionButtonSize));
+    }
+
+    auto togglesRow = this->getRowBounds(0.91f, optionRowSize, 5);
+    this->stemsButton->setBounds(togglesRow.removeFromLeft(togglesRow.getWidth() / 2));
+    this->doublePrecisionButton->setBounds(togglesRow);
 
     this->renderButton->setBounds(this->getButtonsBounds());
 }
@@ -187,6 +302,7 @@ void RenderDialog::launchFileChooser()
         [this](URL &url) {
             this->renderTarget = url;
             this->updateRenderTargetLabels();
+            this->setOptionButtonsEnabled(true);
         });
 }
 
@@ -195,6 +311,41 @@ void RenderDialog::updateRenderTargetLabels()
     this->pathLabel->setText(this->renderTarget.getLocalFile().getFullPathName(), dontSendNotification);
 }
 
+void RenderDialog::updateOptionButtons()
+{
+    for (int i = 0; i < this->bitDepthButtons.size(); ++i)
+    {
+        this->bitDepthButtons.getUnchecked(i)->setToggleState(
+            this->options.bitDepth == renderBitDepths[i], dontSendNotification);
+    }
+
+    for (int i = 0; i < this->blockSizeButtons.size(); ++i)
+    {
+        this->blockSizeButtons.getUnchecked(i)->setToggleState(
+            this->options.blockSize == renderBlockSizes[i], dontSendNotification);
+    }
+
+    this->stemsButton->setToggleState(this->options.renderStems, dontSendNotification);
+    this->doublePrecisionButton->setToggleState(this->options.doublePrecision, dontSendNotification);
+}
+
+void RenderDialog::setOptionButtonsEnabled(bool shouldBeEnabled)
+{
+    for (auto *button : this->bitDepthButtons)
+    {
+        button->setEnabled(shouldBeEnabled);
+    }
+
+    for (auto *button : this->blockSizeButtons)
+    {
+        button->setEnabled(shouldBeEnabled);
+    }
+
+    // stems are written next to the target, which needs to be a local file
+    this->stemsButton->setEnabled(shouldBeEnabled && this->renderTarget.isLocalFile());
+    this->doublePrecisionButton->setEnabled(shouldBeEnabled);
+}
+
 bool RenderDialog::keyPressed(const KeyPress &key)
 {
     if (key == KeyPress::escapeKey)
@@ -216,8 +367,11 @@ void RenderDialog::startOrAbortRender()
             this->renderTarget.getParentURL().getLocalFile().getFullPathName());
 #endif
 
+        auto renderOptions = this->options;
+        renderOptions.renderStems = renderOptions.renderStems && this->renderTarget.isLocalFile();
+
         if (transport.startRender(this->renderTarget, this->format,
-                this->progressBar->getThumbnailResolution()))
+                this->progressBar->getThumbnailResolution(), renderOptions))
         {
             this->startTrackingProgress();
         }
@@ -251,12 +405,19 @@ void RenderDialog::timerCallback()
     {
         this->progressBar->update(transport.getRenderingPercentsComplete(),
             transport.getRenderingWaveformThumbnail());
+
+        // the renderer waits for the SoundFonts to load before it starts
+        const auto loadingProgress = transport.getRenderingInstrumentsLoadingProgress();
+        this->captionLabel->setText(loadingProgress < 1.f ?
+            TRANS(I18n::Dialog::renderLoading) + " " + String(roundToInt(loadingProgress * 100.f)) + "%" :
+            TRANS(I18n::Dialog::renderCaption), dontSendNotification);
     }
     else
     {
         this->stopTrackingProgress();
         transport.stopRender();
-        App::Layout().showTooltip({}, MainLayout::TooltipIcon::Success);
+        App::Layout().showTooltip({}, transport.hasRenderingFailed() ?
+            MainLayout::TooltipIcon::Failure : MainLayout::TooltipIcon::Success);
     }
 }
 
@@ -267,6 +428,7 @@ void RenderDialog::startTrackingProgress()
     this->renderButton->setButtonText(TRANS(I18n::Dialog::renderAbort));
     this->browseButton->setMouseCursor(MouseCursor::NormalCursor);
     this->browseButton->setEnabled(false);
+    this->setOptionButtonsEnabled(false);
 }
 
 void RenderDialog::stopTrackingProgress()
@@ -278,6 +440,8 @@ void RenderDialog::stopTrackingProgress()
         transport.getRenderingWaveformThumbnail());
 
     this->renderButton->setButtonText(TRANS(I18n::Dialog::renderProceed));
+    this->captionLabel->setText(TRANS(I18n::Dialog::renderCaption), dontSendNotification);
     this->browseButton->setMouseCursor(MouseCursor::PointingHandCursor);
     this->browseButton->setEnabled(true);
+    this->setOptionButtonsEnabled(true);
 }
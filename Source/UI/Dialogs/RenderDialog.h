@@ -59,6 +59,10 @@ private:
     void startOrAbortRender();
     void stopRender();
 
+    RenderOptions options;
+    void updateOptionButtons();
+    void setOptionButtonsEnabled(bool shouldBeEnabled);
+
 private:
 
     class SimpleWaveformProgressBar final : public Component
@@ -90,5 +94,12 @@ private:
     UniquePointer<SimpleWaveformProgressBar> progressBar;
     UniquePointer<TextButton> renderButton;
 
+    UniquePointer<Label> bitDepthLabel;
+    OwnedArray<ToggleButton> bitDepthButtons;
+    UniquePointer<Label> blockSizeLabel;
+    OwnedArray<ToggleButton> blockSizeButtons;
+    UniquePointer<ToggleButton> stemsButton;
+    UniquePointer<ToggleButton> doublePrecisionButton;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderDialog)
 };
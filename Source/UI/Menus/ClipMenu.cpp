@@ -26,6 +26,7 @@
 #include "PatternOperations.h"
 #include "ArpeggiationSequenceModifier.h"
 #include "Workspace.h"
+#include "Models/MarkovModel.h"
 
 ClipMenu::ClipMenu(const Clip &clip, WeakReference<UndoStack> undoStack) :
     ClipModifiersMenu(clip, undoStack),
@@ -147,8 +148,12 @@ MenuPanel::Menu ClipMenu::makeRefactoringMenu()
     menu.add(MenuItem::item(Icons::inversion, CommandIDs::MelodicInversion,
         TRANS(I18n::Menu::Refactor::melodicInversion))->closesMenu());
 
-    menu.add(MenuItem::item(Icons::inversion, CommandIDs::StartMarkovMode,
-    "Gen Markov Stuff")->closesMenu());
+    menu.add(MenuItem::item(Icons::inversion, "Gen Markov Stuff")->
+        withSubmenu()->
+        withAction([this]()
+        {
+            this->updateContent(this->makeMarkovOrderMenu(), MenuPanel::SlideLeft);
+        }));
 
     menu.add(MenuItem::item(Icons::retrograde, CommandIDs::Retrograde,
         TRANS(I18n::Menu::Refactor::retrograde))->closesMenu());
@@ -215,6 +220,25 @@ MenuPanel::Menu ClipMenu::makeQuantizationMenu()
     return menu;
 }
 
+MenuPanel::Menu ClipMenu::makeMarkovOrderMenu()
+{
+    MenuPanel::Menu menu;
+
+    menu.add(MenuItem::item(Icons::back, TRANS(I18n::Menu::back))->withAction([this]()
+    {
+        this->updateContent(this->makeRefactoringMenu(), MenuPanel::SlideRight);
+    }));
+
+    for (int order = 1; order <= MarkovModel::maxOrder; ++order)
+    {
+        menu.add(MenuItem::item(Icons::ellipsis,
+            CommandIDs::StartMarkovMode + order - 1,
+            "Order " + String(order))->closesMenu());
+    }
+
+    return menu;
+}
+
 MenuPanel::Menu ClipMenu::makeChannelSelectionMenu()
 {
     MenuPanel::Menu menu;
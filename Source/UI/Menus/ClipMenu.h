@@ -70,6 +70,7 @@ private:
     MenuPanel::Menu makeDefaultMenu();
     MenuPanel::Menu makeRefactoringMenu();
     MenuPanel::Menu makeQuantizationMenu();
+    MenuPanel::Menu makeMarkovOrderMenu();
     MenuPanel::Menu makeChannelSelectionMenu();
     MenuPanel::Menu makeInstrumentSelectionMenu();
 
@@ -295,11 +295,21 @@ void ProjectMenu::showRenderMenu()
 
     menu.add(MenuItem::item(Icons::render, CommandIDs::RenderToWAV,
         TRANS(I18n::Menu::Project::renderWav))->closesMenu());
+
+    // same goes for AiffAudioFormatWriter
+    menu.add(MenuItem::item(Icons::render, CommandIDs::RenderToAIFF,
+        TRANS(I18n::Menu::Project::renderAiff))->closesMenu());
 #endif
 
     menu.add(MenuItem::item(Icons::render, CommandIDs::RenderToFLAC,
         TRANS(I18n::Menu::Project::renderFlac))->closesMenu());
 
+    menu.add(MenuItem::item(Icons::render, CommandIDs::RenderToOGG,
+        TRANS(I18n::Menu::Project::renderOgg))->closesMenu());
+
+    menu.add(MenuItem::item(Icons::render, CommandIDs::RenderToRAW,
+        TRANS(I18n::Menu::Project::renderRaw))->closesMenu());
+
     menu.add(MenuItem::item(Icons::commit, CommandIDs::ExportMidi,
         TRANS(I18n::Menu::Project::renderMidi))->closesMenu());
 
@@ -40,6 +40,7 @@
 #include "Pattern.h"
 
 #include "Models/MarkovModel.h"
+#include "Models/MarkovGenerator.h"
 
 #include "UndoStack.h"
 #include "AutomationTrackActions.h"
@@ -721,20 +722,6 @@ void SequencerOperations::melodicInversion(const NoteListBase &notes,
     sequence->changeGroup(groupBefore, groupAfter, undoable);
 }
 
-void SequencerOperations::startMarkovMode(const NoteListBase &notes)
-{
-    // sort the selection
-    Array<Note> sortedSelection;
-    for (int i = 0; i < notes.size(); ++i)
-    {
-        const auto &note = notes.getNoteUnchecked(i);
-        sortedSelection.addSorted(note, note);
-    }
-
-    auto  mm = MarkovModel();
-    mm.generateFromSequence(sortedSelection);
-}
-
 bool SequencerOperations::isBarStart(float absBeat,
     WeakReference<TimeSignaturesAggregator> timeContext)
 {
@@ -2709,6 +2696,85 @@ UniquePointer<MidiTrackNode> SequencerOperations::createPianoTrack(const Array<N
     return newNode;
 }
 
+UniquePointer<MidiTrackNode> SequencerOperations::createMarkovTrack(const NoteListBase &notes,
+    const Clip &clip, int order, int64 seed)
+{
+    if (notes.size() == 0) { return {}; }
+
+    Array<Note> sortedSelection;
+    sortedSelection.ensureStorageAllocated(notes.size());
+    for (int i = 0; i < notes.size(); ++i)
+    {
+        const auto &note = notes.getNoteUnchecked(i);
+        sortedSelection.addSorted(note, note);
+    }
+
+    MarkovModel model;
+    model.generateFromSequence(sortedSelection, order);
+
+    const auto &sourceStates = model.getSequence();
+
+    // the model only knows the sound objects, one per onset, and not the time
+    // between them, so the rhythm is restored by sampling one of the gaps
+    // to the next onset which followed the same sound object in the source
+    std::vector<std::vector<float>> onsetGaps(model.Size());
+    {
+        Array<float> onsets;
+        for (const auto &note : sortedSelection)
+        {
+            if (onsets.isEmpty() || onsets.getLast() != note.getBeat())
+            {
+                onsets.add(note.getBeat());
+            }
+        }
+
+        jassert(onsets.size() == int(sourceStates.size()));
+        for (int i = 0; i + 1 < onsets.size(); ++i)
+        {
+            onsetGaps[sourceStates[i]].push_back(onsets[i + 1] - onsets[i]);
+        }
+    }
+
+    const MarkovGenerator generator(model);
+    const auto states = generator.generate(int(sourceStates.size()), seed);
+
+    // starting where the source starts;
+    // all generated notes are inserted at once by createPianoTrack
+    Array<Note> events;
+    events.ensureStorageAllocated(int(states.size()));
+
+    Random random(seed);
+    auto beat = findStartBeat(sortedSelection);
+    for (const auto state : states)
+    {
+        float soundLength = 0.f;
+        const auto &sound = model.getStates().getSound(state);
+        if (const auto *note = std::get_if<Note>(&sound))
+        {
+            events.add(note->withBeat(beat));
+            soundLength = note->getLength();
+        }
+        else if (const auto *chord = std::get_if<std::vector<Note>>(&sound))
+        {
+            for (const auto &chordNote : *chord)
+            {
+                events.add(chordNote.withBeat(beat));
+                soundLength = jmax(soundLength, chordNote.getLength());
+            }
+        }
+        else if (const auto *rest = std::get_if<float>(&sound))
+        {
+            soundLength = *rest;
+        }
+
+        // only the source's last sound object might have never been followed
+        const auto &gaps = onsetGaps[state];
+        beat += gaps.empty() ? soundLength : gaps[random.nextInt(int(gaps.size()))];
+    }
+
+    return createPianoTrack(events, { clip });
+}
+
 UniquePointer<MidiTrackNode> SequencerOperations::createAutomationTrack(const AutomationSequence *source, const Clip &clip)
 {
     Array<AutomationEvent> events;
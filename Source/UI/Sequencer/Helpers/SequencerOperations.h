@@ -116,7 +116,6 @@ struct SequencerOperations final
 
     static void retrograde(const NoteListBase &notes, bool undoable = true, bool shouldCheckpoint = true);
     static void melodicInversion(const NoteListBase &notes, bool undoable = true, bool shouldCheckpoint = true);
-    static void startMarkovMode(const NoteListBase &notes);
 
     static void makeStaccato(const NoteListBase &notes,
         float newLength, bool undoable = true, bool shouldCheckpoint = true);
@@ -178,6 +177,13 @@ struct SequencerOperations final
     static UniquePointer<MidiTrackNode> createAutomationTrack(const Array<AutomationEvent> &events, const Pattern *pattern);
     static UniquePointer<MidiTrackNode> createAutomationTrack(const Array<AutomationEvent> &events, const Array<Clip> &clips);
 
+    // Trains a Markov chain of the given order on the notes and creates
+    // a new track with the same number of sound objects generated from it,
+    // spaced by the onset gaps sampled from the source; the same seed
+    // always gives the same track for the same notes
+    static UniquePointer<MidiTrackNode> createMarkovTrack(const NoteListBase &notes,
+        const Clip &clip, int order, int64 seed);
+
     static String generateNextNameForNewTrack(const String &name, const StringArray &allNames);
 
 };
@@ -11,6 +11,8 @@
 #include <JuceHeader.h>
 #include "MarkovEditorComponent.h"
 #include "ProjectNode.h"
+#include "PianoSequence.h"
+#include "MidiTrack.h"
 #include <HelioTheme.h>
 #include "MenuItemComponent.h"
 
@@ -28,10 +30,21 @@ MarkovEditorPanel::MarkovEditorPanel(ProjectNode &project) : project(project)
     this->addAndMakeVisible(this->listBox.get());
 
     this->setSize(350, 36);
+
+    // the model is subscribed first, so that it's up to date
+    // by the time this panel receives the same event
+    this->project.addListener(&this->model);
+    this->project.addListener(this);
+
+    // the editable scope might have been set before this panel was created,
+    // and it's only broadcast again when it changes
+    this->bindToTrack(dynamic_cast<MidiTrack *>(this->project.getLastShownTrack().get()));
 }
 
 MarkovEditorPanel::~MarkovEditorPanel()
 {
+    this->project.removeListener(this);
+    this->project.removeListener(&this->model);
 }
 
 void MarkovEditorPanel::paint (juce::Graphics& g)
@@ -79,5 +92,124 @@ void MarkovEditorPanel::resized()
 
 int MarkovEditorPanel::getNumRows()
 {
-    return 0;
+    return this->rows.size();
+}
+
+void MarkovEditorPanel::paintListBoxItem(int rowNumber, Graphics &g, int w, int h, bool rowIsSelected)
+{
+    if (!isPositiveAndBelow(rowNumber, this->rows.size())) { return; }
+
+    if (rowIsSelected)
+    {
+        g.fillAll(findDefaultColour(Label::textColourId).withAlpha(0.08f));
+    }
+
+    const auto state = this->rows.getUnchecked(rowNumber);
+    const auto &sound = this->model.getStates().getSound(state);
+
+    g.setColour(findDefaultColour(Label::textColourId));
+    g.setFont(Globals::UI::Fonts::S);
+    g.drawText(getSoundName(sound), 4, 0, w - 40, h, Justification::centredLeft, true);
+    g.drawText(String(this->model.getSoundFrequency(state)), w - 36, 0, 32, h, Justification::centredRight, false);
+}
+
+String MarkovEditorPanel::getSoundName(const MarkovModel::Sound &sound)
+{
+    if (const auto *note = std::get_if<Note>(&sound))
+    {
+        return MidiMessage::getMidiNoteName(note->getKey(), true, true, 3);
+    }
+    else if (const auto *chord = std::get_if<std::vector<Note>>(&sound))
+    {
+        StringArray names;
+        for (const auto &chordNote : *chord)
+        {
+            names.add(MidiMessage::getMidiNoteName(chordNote.getKey(), true, true, 3));
+        }
+
+        return names.joinIntoString(" ");
+    }
+
+    return "-";
+}
+
+//===----------------------------------------------------------------------===//
+// ProjectListener
+//===----------------------------------------------------------------------===//
+
+void MarkovEditorPanel::onAddMidiEvent(const MidiEvent &event)
+{
+    if (event.getSequence() == this->model.getSourceSequence())
+    {
+        this->triggerAsyncUpdate();
+    }
+}
+
+void MarkovEditorPanel::onChangeMidiEvent(const MidiEvent &oldEvent, const MidiEvent &newEvent)
+{
+    if (newEvent.getSequence() == this->model.getSourceSequence())
+    {
+        this->triggerAsyncUpdate();
+    }
+}
+
+void MarkovEditorPanel::onRemoveMidiEvent(const MidiEvent &event)
+{
+    if (event.getSequence() == this->model.getSourceSequence())
+    {
+        this->triggerAsyncUpdate();
+    }
+}
+
+void MarkovEditorPanel::onChangeViewEditableScope(MidiTrack *const track,
+    const Clip &clip, bool shouldFocus)
+{
+    this->bindToTrack(track);
+}
+
+void MarkovEditorPanel::bindToTrack(MidiTrack *track)
+{
+    if (track == nullptr)
+    {
+        return;
+    }
+
+    auto *sequence = dynamic_cast<PianoSequence *>(track->getSequence());
+    if (sequence == nullptr || sequence == this->model.getSourceSequence())
+    {
+        return;
+    }
+
+    this->model.setSourceSequence(sequence);
+    this->triggerAsyncUpdate();
+}
+
+void MarkovEditorPanel::onReloadProjectContent(const Array<MidiTrack *> &tracks,
+    const ProjectMetadata *meta)
+{
+    this->triggerAsyncUpdate();
+}
+
+void MarkovEditorPanel::handleAsyncUpdate()
+{
+    // only the frequencies are needed here, they are always up to date,
+    // so this never triggers rebuilding the model's matrices
+    this->rows.clearQuick();
+    for (int i = 0; i < this->model.Size(); ++i)
+    {
+        const auto state = MarkovModel::StateId(i);
+        if (this->model.getSoundFrequency(state) > 0)
+        {
+            this->rows.add(state);
+        }
+    }
+
+    std::stable_sort(this->rows.begin(), this->rows.end(),
+        [this](MarkovModel::StateId a, MarkovModel::StateId b)
+        {
+            return this->model.getSoundFrequency(a) > this->model.getSoundFrequency(b);
+        });
+
+    this->listBox->updateContent();
+    this->repaint();
 }
\ No newline at end of file
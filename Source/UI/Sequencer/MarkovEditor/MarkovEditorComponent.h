@@ -13,13 +13,17 @@
 #include <ColourIDs.h>
 #include <Common.h>
 #include <JuceHeader.h>
+#include "Models/MarkovModel.h"
+#include "ProjectListener.h"
 
 class ProjectNode;
 //==============================================================================
 /*
 */
 class MarkovEditorPanel final : public Component,
-private ListBoxModel
+private ListBoxModel,
+private ProjectListener, // follows the active track
+private AsyncUpdater // coalesces the model updates to refresh the list
 {
 public:
     MarkovEditorPanel(ProjectNode &project);
@@ -28,10 +32,26 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 
-    void paintListBoxItem(int, Graphics &, int, int, bool) override {}
+    void paintListBoxItem(int rowNumber, Graphics &g, int w, int h, bool rowIsSelected) override;
     int getNumRows() override;
 
 private:
+
+    void onAddMidiEvent(const MidiEvent &event) override;
+    void onChangeMidiEvent(const MidiEvent &oldEvent, const MidiEvent &newEvent) override;
+    void onRemoveMidiEvent(const MidiEvent &event) override;
+    void onChangeViewEditableScope(MidiTrack *const track,
+        const Clip &clip, bool shouldFocus) override;
+    void onReloadProjectContent(const Array<MidiTrack *> &tracks,
+        const ProjectMetadata *meta) override;
+
+    void handleAsyncUpdate() override;
+
+    // Trains the model on the track's notes, unless it's not a piano track
+    void bindToTrack(MidiTrack *track);
+
+    static String getSoundName(const MarkovModel::Sound &sound);
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MarkovEditorPanel)
 
   ProjectNode &project;
@@ -40,4 +60,10 @@ private:
   const Colour borderLineLight = findDefaultColour(ColourIDs::TrackScroller::borderLineLight);
 
   UniquePointer<ListBox> listBox;
+
+  // trained on the active track, kept up to date on any edits
+  MarkovModel model;
+
+  // the states currently present in the track, most frequent first
+  Array<MarkovModel::StateId> rows;
 };
@@ -47,6 +47,7 @@
 #include "InteractiveActions.h"
 #include "SerializationKeys.h"
 #include "Arpeggiator.h"
+#include "Models/MarkovModel.h"
 #include "CommandPaletteChordConstructor.h"
 #include "CommandPaletteMoveNotesMenu.h"
 #include "LassoListeners.h"
@@ -1442,9 +1443,6 @@ void PianoRoll::handleCommandMessage(int commandId)
     case CommandIDs::MelodicInversion:
         SequencerOperations::melodicInversion(this->getLassoOrEntireSequence());
         break;
-    case CommandIDs::StartMarkovMode:
-        SequencerOperations::startMarkovMode(this->getLassoOrEntireSequence());
-        break;
     case CommandIDs::Retrograde:
         SequencerOperations::retrograde(this->getLassoOrEntireSequence());
         break;
@@ -1624,6 +1622,26 @@ void PianoRoll::handleCommandMessage(int commandId)
         break;
     }
 
+    if (commandId >= CommandIDs::StartMarkovMode &&
+        commandId < CommandIDs::StartMarkovMode + MarkovModel::maxOrder)
+    {
+        const auto order = commandId - CommandIDs::StartMarkovMode + 1;
+        const auto seed = int64(Random::getSystemRandom().nextInt(std::numeric_limits<int>::max()));
+        auto trackPreset = SequencerOperations::createMarkovTrack(this->getLassoOrEntireSequence(),
+            this->activeClip, order, seed);
+
+        if (trackPreset != nullptr)
+        {
+            // the seed is kept in the track name, so that the result can be reproduced
+            const auto trackName = this->activeTrack->getTrackName() + " (seed " + String(seed) + ")";
+            this->project.getUndoStack()->beginNewTransaction(UndoActionIDs::AddNewTrack);
+            InteractiveActions::addNewTrack(this->project,
+                move(trackPreset), trackName, true,
+                UndoActionIDs::AddNewTrack, "Markov chain, order " + String(order) + ", seed " + String(seed),
+                true);
+        }
+    }
+
     RollBase::handleCommandMessage(commandId);
 }
 
@@ -717,6 +717,15 @@ void SequencerLayout::handleCommandMessage(int commandId)
     case CommandIDs::RenderToWAV:
         this->proceedToRenderDialog(RenderFormat::WAV);
         return;
+    case CommandIDs::RenderToAIFF:
+        this->proceedToRenderDialog(RenderFormat::AIFF);
+        return;
+    case CommandIDs::RenderToOGG:
+        this->proceedToRenderDialog(RenderFormat::OGG);
+        return;
+    case CommandIDs::RenderToRAW:
+        this->proceedToRenderDialog(RenderFormat::RAW);
+        return;
     case CommandIDs::SwitchBetweenRolls:
         if (!this->rollContainer->canAnimate(RollsSwitchingProxy::Timers::rolls))
         {